@@ -44,6 +44,11 @@ echo "Creating state directory..."
 mkdir -p /var/lib/omen-rgb-keyboard
 chmod 755 /var/lib/omen-rgb-keyboard
 
+# Expose the saved state to the firmware loader, which restores it at boot
+echo "Linking saved state into the firmware search path..."
+mkdir -p /lib/firmware
+ln -sfn /var/lib/omen-rgb-keyboard /lib/firmware/omen-rgb-keyboard
+
 # Load the module immediately
 echo "Loading module..."
 modprobe hp-wmi
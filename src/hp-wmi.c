@@ -30,6 +30,27 @@
 #include <linux/namei.h>
 #include <linux/mount.h>
 #include <linux/syscalls.h>
+#include <linux/firmware.h>
+#include <linux/moduleparam.h>
+#include <linux/leds.h>
+#include <linux/led-class-multicolor.h>
+#include <linux/input.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/mutex.h>
+#include <linux/atomic.h>
+#include <linux/miscdevice.h>
+#include <linux/compat.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/version.h>
+
+#include "omen_rgb.h"
+#include <linux/ktime.h>
+#include <linux/pm.h>
+#include <linux/power_supply.h>
+#include <linux/notifier.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -56,6 +77,13 @@ MODULE_VERSION("1.0");
 MODULE_LICENSE("GPL");
 
 #define HPWMI_BIOS_GUID "5FB7F034-2C63-45e9-BE91-3D44E2C707E4"
+#define HPWMI_EVENT_GUID "95F24279-4D7B-4334-9387-ACCDC67EF61C"
+
+/* Event raised when the backlight is toggled with the keyboard hotkey */
+#define HPWMI_BACKLIT_KB_BRIGHTNESS 0x0D
+/* Backlight status replies, anything else is treated as on */
+#define HPWMI_BACKLIGHT_ON 0xE4
+#define HPWMI_BACKLIGHT_OFF 0x64
 
 enum hp_wmi_commandtype
 {
@@ -170,10 +198,57 @@ out_free:
 	return ret;
 }
 
+/*
+ * Firmware transactions. The color buffer is read, patched and written back
+ * as a whole, so every query runs inside a transaction and a GET/SET pair
+ * never interleaves with another caller. Waiting time and the number of
+ * callers holding or queued on the lock are kept for the firmware_stats
+ * attribute.
+ */
+static DEFINE_MUTEX(hp_wmi_lock);
+
+static struct hp_wmi_stats
+{
+	u64 transactions;
+	u64 contended;
+	u64 wait_us;
+	u64 max_wait_us;
+	atomic_t depth;
+	int max_depth;
+} hp_wmi_stats = {
+	.depth = ATOMIC_INIT(0),
+};
+
+static void hp_wmi_begin(void)
+{
+	int depth = atomic_inc_return(&hp_wmi_stats.depth);
+	ktime_t start;
+	u64 us = 0;
+
+	if (!mutex_trylock(&hp_wmi_lock)) {
+		start = ktime_get();
+		mutex_lock(&hp_wmi_lock);
+		us = ktime_us_delta(ktime_get(), start);
+		hp_wmi_stats.contended++;
+	}
+
+	hp_wmi_stats.transactions++;
+	hp_wmi_stats.wait_us += us;
+	hp_wmi_stats.max_wait_us = max(hp_wmi_stats.max_wait_us, us);
+	hp_wmi_stats.max_depth = max(hp_wmi_stats.max_depth, depth);
+}
+
+static void hp_wmi_end(void)
+{
+	atomic_dec(&hp_wmi_stats.depth);
+	mutex_unlock(&hp_wmi_lock);
+}
+
 #define ZONE_COUNT 4
 
 /* Animation system constants */
-#define ANIMATION_TIMER_INTERVAL_MS 50
+#define ANIMATION_FRAME_RATE_DEFAULT 20
+#define ANIMATION_FRAME_RATE_MAX 60
 #define ANIMATION_SPEED_MIN 1
 #define ANIMATION_SPEED_MAX 10
 #define ANIMATION_SPEED_DEFAULT 1
@@ -190,9 +265,24 @@ enum animation_mode
 	ANIMATION_CANDLE,
 	ANIMATION_AURORA,
 	ANIMATION_DISCO,
+	ANIMATION_REACTIVE,
+	ANIMATION_RIPPLE,
+	ANIMATION_HEATMAP,
+	ANIMATION_STREAM,		/* Frames pushed by userspace, see struct omen_rgb_ring */
 	ANIMATION_COUNT
 };
 
+/* Sets of modes as BIT(mode) masks, see fourzone_modes() */
+#define REACTIVE_MODES (BIT(ANIMATION_REACTIVE) | BIT(ANIMATION_RIPPLE) | \
+			BIT(ANIMATION_HEATMAP))
+#define SLOW_MODES (BIT(ANIMATION_BREATHING) | BIT(ANIMATION_RAINBOW) | \
+		    BIT(ANIMATION_WAVE) | BIT(ANIMATION_AURORA))
+/* Modes that need a frame on every tick */
+#define CONTINUOUS_MODES (GENMASK(ANIMATION_COUNT - 1, 0) & \
+			  ~(BIT(ANIMATION_STATIC) | REACTIVE_MODES))
+
+#define ZONE_MODE_GLOBAL 0xff	/* The zone follows the global mode */
+
 struct color_platform
 {
 	u8 blue;
@@ -203,46 +293,365 @@ struct color_platform
 struct platform_zone
 {
 	u8 offset; /* position in returned buffer */
-	struct device_attribute *attr;
 	struct color_platform colors;
 };
 
-/* Global brightness control */
-static int global_brightness = 100;											 /* Store brightness as percentage */
-static struct platform_zone original_colors[ZONE_COUNT]; /* Store original colors */
+#define FOURZONE_STATE_SIZE 128
+
+/* LED class device for one zone, or for the whole keyboard when zone < 0 */
+struct fourzone_led
+{
+	struct led_classdev_mc mc;
+	struct mc_subled subleds[3];
+	struct fourzone_priv *priv;
+	int zone;
+	struct color_platform color; /* Intensities last applied to the zone */
+};
+
+#define REACT_HEAT_MAX 1000
+#define REACT_HEAT_PER_KEY 120
+
+/*
+ * Key activity recorded by the input handler. Events only update these
+ * fields, rendering happens in the frame worker.
+ */
+struct fourzone_react
+{
+	unsigned long zone_hit[ZONE_COUNT];		/* Last keypress per zone, in jiffies */
+	int heat[ZONE_COUNT];						/* Typing activity, 0 - REACT_HEAT_MAX */
+	unsigned long heat_stamp[ZONE_COUNT];	/* When heat was last decayed */
+	unsigned long ripple_start;
+	int ripple_origin;
+	ktime_t pending;								/* Oldest keypress not yet displayed */
+};
+
+/* What to give up while running on battery */
+enum battery_policy
+{
+	BATTERY_POLICY_NONE = 0,
+	BATTERY_POLICY_FPS,			/* Cap the frame rate at battery_fps */
+	BATTERY_POLICY_DIM,			/* Cap the brightness at battery_brightness */
+	BATTERY_POLICY_STATIC,	/* Show the base colors without animation */
+	BATTERY_POLICY_OFF,			/* Turn the lighting off */
+	BATTERY_POLICY_COUNT
+};
+
+static const char *const battery_policy_names[BATTERY_POLICY_COUNT] = {
+	"none", "fps", "dim", "static", "off"
+};
+
+/* Keyboard idle dimming */
+enum idle_state
+{
+	IDLE_ACTIVE = 0,
+	IDLE_FADING,
+	IDLE_DIMMED,
+};
+
+/* Time from a keypress to the commit of the frame showing it */
+struct fourzone_latency
+{
+	u64 count;
+	u64 total_us;
+	u64 last_us;
+	u64 max_us;
+};
+
+/* Output transfer curves, see fourzone_present() */
+enum gamma_curve {
+	GAMMA_LINEAR = 0,
+	GAMMA_1_8,
+	GAMMA_2_2,
+	GAMMA_2_6,
+	GAMMA_COUNT
+};
+
+/*
+ * Everything a frame is rendered from. Writers update it under config_lock,
+ * the frame worker takes a consistent copy once per frame without locking,
+ * see fourzone_config_get().
+ */
+struct fourzone_config
+{
+	enum animation_mode mode;
+	int speed;
+	int brightness;													/* Percent */
+	struct color_platform colors[ZONE_COUNT];	/* Base colors */
+	u8 gain[ZONE_COUNT];										/* LED class brightness per zone */
+	u8 level;																/* LED class brightness of the keyboard */
+	u8 gamma[3];														/* enum gamma_curve per channel, RGB order */
+	u8 calibrated;													/* Zones with a non-identity calib matrix */
+	s16 calib[ZONE_COUNT][9];								/* Row-major RGB matrix per zone, Q10 */
+	u8 zone_mode[ZONE_COUNT];								/* enum animation_mode or ZONE_MODE_GLOBAL */
+	u8 zone_speed[ZONE_COUNT];							/* 0 follows speed */
+};
+
+/* Color in the output stage, 65535 is full scale */
+struct color16
+{
+	u16 red;
+	u16 green;
+	u16 blue;
+};
+
+/* Color in OKLab, Q16, see rgb16_to_oklab() */
+struct oklab
+{
+	s32 l;
+	s32 a;
+	s32 b;
+};
+
+/*
+ * Output scaling cached by the frame worker. Rebuilt only when the base
+ * colors, the gains or the effective brightness change, so a static frame
+ * costs a copy and a commit.
+ */
+struct fourzone_palette
+{
+	bool valid;
+	int brightness;													/* Effective, after brightness_cap */
+	u8 gain[ZONE_COUNT];
+	u8 level;
+	struct color_platform base[ZONE_COUNT];
+	u32 scale[ZONE_COUNT];									/* gain * level * brightness, Q16 */
+	struct color16 colors[ZONE_COUNT];				/* Base colors, prescaled */
+};
+
+/*
+ * Per-device lighting state. Everything the driver knows about the lighting
+ * device lives here rather than in globals. Only one device is supported:
+ * the misc device and LED names, the WMI event handler and the firmware call
+ * lock and statistics are still singletons, so a second instance would fail
+ * to register.
+ */
+struct fourzone_priv
+{
+	struct device *dev;
+
+	/* Configuration published to the frame worker */
+	seqlock_t config_lock;
+	struct fourzone_config config;
+	struct fourzone_config frame;	/* Worker's copy for the frame being rendered */
+	struct fourzone_palette palette;	/* Output scaling for frame, worker only */
+	bool dither;	/* Temporal dithering allowed */
+	bool dither_active;	/* Dithering the frame being rendered */
+	u8 dither_err[ZONE_COUNT][3];	/* Residue carried to the next frame */
+
+	/* Crossfade after mode and color changes, worker only */
+	unsigned int transition_ms;	/* 0 switches instantly */
+	bool transition_active;
+	unsigned long transition_start;
+	unsigned long transition_len;
+	unsigned int transition_pos;	/* Progress of this frame, 0 - 256 */
+	u8 transition_modes[ZONE_COUNT];	/* Target as last seen */
+	struct color_platform transition_colors[ZONE_COUNT];
+	struct oklab transition_from[ZONE_COUNT];
+	struct color16 rendered[ZONE_COUNT];	/* Last frame entering the output stage */
+	bool rendered_valid;
+
+	/* Randomness for sparkle and candle, worker only */
+	u32 seed;	/* Fixed seed, 0 draws a new one per animation start */
+	bool rng_reseed;	/* Set by start_animation() */
+	u32 noise_seed;
+	u32 rng[ZONE_COUNT];	/* xorshift32 state per zone */
+	unsigned long sparkle_at[ZONE_COUNT];	/* Start of the last sparkle */
+	unsigned long render_last;	/* Previous animated frame */
+	unsigned long render_dt;	/* Time since, for effects driven by chance */
+	struct fourzone_config notified;	/* As last announced to sysfs pollers */
+	struct color_platform displayed[ZONE_COUNT];	/* Last committed frame, under config_lock */
+	struct work_struct notify_work;
+
+	struct platform_zone zone_data[ZONE_COUNT];			 /* Colors as written to the hardware */
+	u8 fw_state[FOURZONE_STATE_SIZE];	 /* Shadow of the firmware color buffer */
+	bool fw_stale;							 /* Shadow may not match the hardware */
+
+	/* LED class integration, gains are set by the LED core and triggers */
+	struct fourzone_led leds[ZONE_COUNT + 1];
+
+	/* Animation system */
+	struct timer_list animation_timer;
+	struct timer_list animation_timer_lp;	/* Deferrable, for low power mode */
+	struct work_struct animation_work;
+	unsigned long animation_start_time;
+	bool animation_active;
+
+	/* Set once userspace changed anything, so a late profile does not override it */
+	bool state_user_set;
+
+	/* Keypress input for the reactive effects and idle dimming */
+	struct input_handler input_handler;
+	spinlock_t react_lock;	/* Protects react and the idle state */
+	struct fourzone_react react;
+	struct fourzone_latency latency;
+
+	/* Idle dimming, driven by keypresses */
+	unsigned int idle_timeout;	/* Seconds without input, 0 disables dimming */
+	unsigned int idle_fade;	/* Fade out duration in ms */
+	enum idle_state idle_state;
+	unsigned long idle_fade_start;
+	unsigned long last_input;
+	struct delayed_work idle_work;
+	int output_level;	/* Idle level of the frame being rendered, percent */
+
+	/* Frame rate and on-battery policy */
+	unsigned int frame_rate;
+	enum battery_policy battery_policy;
+	unsigned int battery_fps;
+	unsigned int battery_brightness;
+	unsigned int fps_cap;				/* Applied frame rate cap, 0 for none */
+	int brightness_cap;					/* Applied brightness ceiling, percent */
+	bool policy_hold;						/* Applied policy suspends animations */
+	bool on_battery;
+	unsigned long power_since;	/* Start of the current power state */
+	u64 power_ms[2];						/* Time spent on AC and on battery */
+	struct notifier_block psy_nb;
+	struct work_struct power_work;
+	struct mutex power_lock;		/* Serializes policy changes */
+
+	/* Low power scheduling and the wakeups it saves */
+	bool low_power;
+	u64 timer_fires;
+	u64 timer_fires_deferred;
+	unsigned long wakeup_window;	/* Start of the current one second window */
+	unsigned int wakeup_window_count;
+	unsigned int wakeup_rate;	/* Non-deferrable fires in the last window */
+
+	/* Parking while the output is dark and cannot change */
+	bool parked;
+	unsigned long parked_since;
+	u64 parked_ms;
+	bool backlight_off;	/* Backlight switched off by the firmware hotkey */
+	struct work_struct backlight_work;
+
+	/* Scene interface, see omen_rgb.h */
+	struct miscdevice misc;
+
+	/* Frame streaming through the mmap()ed ring */
+	struct omen_rgb_ring *ring;
+	struct color_platform stream_frame[ZONE_COUNT];	/* Newest frame taken */
+	bool stream_valid;
+	u32 stream_consumed;	/* Value of ring->produced when last taken */
+	u32 stream_shown;
+	u32 stream_dropped;
+	u64 stream_torn;			/* Slots caught mid-write, retried next frame */
+
+	/* Persistence and power management */
+	struct delayed_work save_work;
+	bool suspended;
+	unsigned long suspended_phase;	/* Animation position when suspended */
+};
+
+static_assert((int)OMEN_RGB_MODE_COUNT == (int)ANIMATION_COUNT);
+static_assert(OMEN_RGB_ZONES == ZONE_COUNT);
+static_assert(OMEN_RGB_ZONE_GLOBAL == ZONE_MODE_GLOBAL);
 
-/* Animation system */
-static enum animation_mode current_animation = ANIMATION_STATIC;
-static int animation_speed = ANIMATION_SPEED_DEFAULT;
-static struct timer_list animation_timer;
-static struct work_struct animation_work;
-static unsigned long animation_start_time;
-static bool animation_active = false;
+static const char *const animation_mode_names[ANIMATION_COUNT] = {
+	"static", "breathing", "rainbow", "wave", "pulse",
+	"chase", "sparkle", "candle", "aurora", "disco",
+	"reactive", "ripple", "heatmap", "stream"
+};
 
 /* State persistence */
 #define STATE_FILE_PATH "/var/lib/omen-rgb-keyboard/state"
-struct animation_state {
+#define STATE_FIRMWARE_NAME "omen-rgb-keyboard/state"
+#define STATE_SAVE_DELAY_MS 500
+#define STATE_MAGIC 0x4247524f		/* "ORGB" */
+#define STATE_VERSION 2
+
+/* Layout before the header was added, still accepted when loading */
+struct animation_state_v0 {
 	enum animation_mode mode;
 	int speed;
 	int brightness;
 	struct color_platform colors[ZONE_COUNT];
 };
 
+struct animation_state {
+	u32 magic;
+	u32 version;
+	struct animation_state_v0 base;
+	u8 gamma[3];
+	u8 reserved;
+	s16 calib[ZONE_COUNT][9];
+	/* Version 2 */
+	u8 zone_mode[ZONE_COUNT];
+	u8 zone_speed[ZONE_COUNT];
+};
+
+#define STATE_V1_SIZE offsetof(struct animation_state, zone_mode)
+
 /* Function declarations */
-static void start_animation(void);
-static void stop_animation(void);
+static void start_animation(struct fourzone_priv *priv);
+static void animation_arm_timer(struct fourzone_priv *priv);
+static void animation_delete_timers(struct fourzone_priv *priv, bool sync);
+static void animation_kick(struct fourzone_priv *priv);
+static void stop_animation(struct fourzone_priv *priv);
 static void animation_work_func(struct work_struct *work);
 static void animation_timer_callback(struct timer_list *t);
-static void save_animation_state(void);
-static void load_animation_state(void);
+static void animation_timer_lp_callback(struct timer_list *t);
+static void save_animation_state(struct fourzone_priv *priv);
+static void fourzone_led_sync(struct fourzone_priv *priv);
+static void load_animation_state(const struct firmware *fw, void *context);
+
+/*
+ * Boot-time state. Everything here is applied during probe without touching
+ * the filesystem, so the lighting is correct even when the module is loaded
+ * from an initramfs before /var is mounted. Explicitly set parameters always
+ * take precedence over the saved profile.
+ */
+static char *initial_mode;
+module_param_named(mode, initial_mode, charp, 0444);
+MODULE_PARM_DESC(mode, "Initial animation mode (static, breathing, rainbow, ...)");
 
-static struct device_attribute *zone_dev_attrs;
-static struct attribute **zone_attrs;
-static struct platform_zone *zone_data;
+static int initial_speed = -1;
+module_param_named(speed, initial_speed, int, 0444);
+MODULE_PARM_DESC(speed, "Initial animation speed (1-10)");
 
-static struct attribute_group zone_attribute_group = {
-		.name = "rgb_zones",
-};
+static int initial_brightness = -1;
+module_param_named(brightness, initial_brightness, int, 0444);
+MODULE_PARM_DESC(brightness, "Initial brightness in percent (0-100)");
+
+static uint initial_colors[ZONE_COUNT];
+static int initial_colors_count;
+module_param_array_named(colors, initial_colors, uint, &initial_colors_count, 0444);
+MODULE_PARM_DESC(colors, "Initial zone colors as 0xRRGGBB, comma separated, zone 0 first");
+
+static char *profile = STATE_FIRMWARE_NAME;
+module_param(profile, charp, 0444);
+MODULE_PARM_DESC(profile, "Saved state loaded through the firmware loader (empty to disable)");
+MODULE_FIRMWARE(STATE_FIRMWARE_NAME);
+
+static uint idle_timeout;
+module_param(idle_timeout, uint, 0444);
+MODULE_PARM_DESC(idle_timeout, "Initial seconds without input before the keyboard fades out (0 disables)");
+
+static char *battery_policy;
+module_param(battery_policy, charp, 0444);
+MODULE_PARM_DESC(battery_policy, "Initial on-battery policy (none, fps, dim, static, off)");
+
+static bool low_power;
+module_param(low_power, bool, 0444);
+MODULE_PARM_DESC(low_power, "Initially schedule slow effects with a deferrable timer");
+
+static uint idle_fade = 1000;
+module_param(idle_fade, uint, 0444);
+MODULE_PARM_DESC(idle_fade, "Initial idle fade out duration in ms");
+
+#ifndef timer_container_of
+#define timer_container_of from_timer
+#endif
+
+#ifndef secs_to_jiffies
+#define secs_to_jiffies(secs) ((unsigned long)(secs) * HZ)
+#endif
+
+/* sysfs binary attributes and their callbacks are const since 6.16 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 16, 0)
+#define FOURZONE_BIN_CONST const
+#else
+#define FOURZONE_BIN_CONST
+#endif
 
 static int parse_rgb(const char *buf, struct platform_zone *zone)
 {
@@ -267,96 +676,329 @@ static int parse_rgb(const char *buf, struct platform_zone *zone)
 	return 0;
 }
 
-static struct platform_zone *match_zone(struct device_attribute *attr)
+/*
+ * A whole frame: exactly one color of six hex digits per zone, separated by
+ * single spaces, e.g. "ff0000 00ff00 0000ff ff00ff". Anything else is
+ * rejected, so a frame is either applied completely or not at all.
+ */
+#define FRAME_TEXT_LEN (ZONE_COUNT * 7 - 1)
+
+static int parse_frame(const char *buf, size_t count,
+		       struct color_platform colors[ZONE_COUNT])
 {
-	u8 zone;
-	for (zone = 0; zone < ZONE_COUNT; zone++)
-	{
-		if ((struct device_attribute *)zone_data[zone].attr == attr)
-			return &zone_data[zone];
+	if (count && buf[count - 1] == '\n')
+		count--;
+	if (count != FRAME_TEXT_LEN)
+		return -EINVAL;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		const char *hex = buf + zone * 7;
+		u8 rgb[3];
+
+		if (zone && hex[-1] != ' ')
+			return -EINVAL;
+		if (hex2bin(rgb, hex, sizeof(rgb)))
+			return -EINVAL;
+
+		colors[zone].red = rgb[0];
+		colors[zone].green = rgb[1];
+		colors[zone].blue = rgb[2];
+	}
+	return 0;
+}
+
+static int parse_animation_mode(const char *buf)
+{
+	for (int mode = 0; mode < ANIMATION_COUNT; mode++) {
+		const char *name = animation_mode_names[mode];
+
+		if (strncmp(buf, name, strlen(name)) == 0)
+			return mode;
+	}
+	return -EINVAL;
+}
+
+static void rgb_to_color(u32 rgb, struct color_platform *color)
+{
+	color->red = (rgb >> 16) & 0xFF;
+	color->green = (rgb >> 8) & 0xFF;
+	color->blue = rgb & 0xFF;
+}
+
+static struct platform_zone *match_zone(struct fourzone_priv *priv,
+																				struct device_attribute *attr)
+{
+	struct dev_ext_attribute *ea = container_of(attr, struct dev_ext_attribute, attr);
+	unsigned long zone = (unsigned long)ea->var;
+
+	if (zone >= ZONE_COUNT)
+		return NULL;
+	return &priv->zone_data[zone];
+}
+
+/* Consistent copy of the configuration, safe from any context */
+static void fourzone_config_get(struct fourzone_priv *priv, struct fourzone_config *cfg)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&priv->config_lock);
+		*cfg = priv->config;
+	} while (read_seqretry(&priv->config_lock, seq));
+}
+
+/*
+ * Ends a userspace change of the saved settings. The change is marked under
+ * the lock, so a saved profile that loads late never overrides it.
+ */
+static void fourzone_config_user_unlock(struct fourzone_priv *priv, unsigned long flags)
+{
+	priv->state_user_set = true;
+	write_sequnlock_irqrestore(&priv->config_lock, flags);
+}
+
+/* Mode and speed a zone runs at, per-zone settings override the global ones */
+static enum animation_mode zone_mode(const struct fourzone_config *cfg, int zone)
+{
+	return cfg->zone_mode[zone] == ZONE_MODE_GLOBAL ? cfg->mode : cfg->zone_mode[zone];
+}
+
+static int zone_speed(const struct fourzone_config *cfg, int zone)
+{
+	return cfg->zone_speed[zone] ?: cfg->speed;
+}
+
+/* Modes running on any zone, as a mask of BIT(mode) */
+static u32 fourzone_modes(const struct fourzone_config *cfg)
+{
+	u32 modes = 0;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		modes |= BIT(zone_mode(cfg, zone));
+	return modes;
+}
+
+/* fourzone_modes() of the published configuration, safe from any context */
+static u32 fourzone_active_modes(struct fourzone_priv *priv)
+{
+	unsigned int seq;
+	u32 modes;
+
+	do {
+		seq = read_seqbegin(&priv->config_lock);
+		modes = fourzone_modes(&priv->config);
+	} while (read_seqretry(&priv->config_lock, seq));
+	return modes;
+}
+
+/* Configuration and displayed frame as of one instant */
+static void fourzone_snapshot(struct fourzone_priv *priv, struct fourzone_config *cfg,
+			      struct color_platform displayed[ZONE_COUNT])
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&priv->config_lock);
+		*cfg = priv->config;
+		memcpy(displayed, priv->displayed, sizeof(priv->displayed));
+	} while (read_seqretry(&priv->config_lock, seq));
+}
+
+/*
+ * Change notifications. Writers only queue notify_work, so a burst of
+ * changes is announced once and writers in atomic context (LED triggers)
+ * can use it too. The work compares against the last announced state and
+ * wakes poll() on exactly the attributes that changed.
+ */
+static void fourzone_config_changed(struct fourzone_priv *priv)
+{
+	schedule_work(&priv->notify_work);
+}
+
+static void notify_work_func(struct work_struct *work)
+{
+	struct fourzone_priv *priv = container_of(work, struct fourzone_priv, notify_work);
+	struct fourzone_config *old = &priv->notified;
+	struct kobject *kobj = &priv->dev->kobj;
+	struct fourzone_config cfg;
+	bool recolored = false;
+
+	fourzone_config_get(priv, &cfg);
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		char name[16];
+
+		if (cfg.zone_mode[zone] != old->zone_mode[zone]) {
+			snprintf(name, sizeof(name), "zone%02d_mode", zone);
+			sysfs_notify(kobj, "rgb_zones", name);
+		}
+		if (cfg.zone_speed[zone] != old->zone_speed[zone]) {
+			snprintf(name, sizeof(name), "zone%02d_speed", zone);
+			sysfs_notify(kobj, "rgb_zones", name);
+		}
+		if (!memcmp(&cfg.colors[zone], &old->colors[zone], sizeof(cfg.colors[zone])))
+			continue;
+		snprintf(name, sizeof(name), "zone%02d", zone);
+		sysfs_notify(kobj, "rgb_zones", name);
+		recolored = true;
+	}
+	if (recolored) {
+		sysfs_notify(kobj, "rgb_zones", "all");
+		sysfs_notify(kobj, "rgb_zones", "frame");
 	}
-	return NULL;
+	if (cfg.brightness != old->brightness)
+		sysfs_notify(kobj, "rgb_zones", "brightness");
+	if (cfg.mode != old->mode)
+		sysfs_notify(kobj, "rgb_zones", "animation_mode");
+	if (cfg.speed != old->speed)
+		sysfs_notify(kobj, "rgb_zones", "animation_speed");
+	if (memcmp(cfg.gamma, old->gamma, sizeof(cfg.gamma)))
+		sysfs_notify(kobj, "rgb_zones", "gamma");
+	if (memcmp(cfg.calib, old->calib, sizeof(cfg.calib)))
+		sysfs_notify(kobj, "rgb_zones", "calibration");
+	if (memcmp(&cfg, old, sizeof(cfg)))
+		sysfs_notify(kobj, "rgb_zones", "state");
+
+	*old = cfg;
+}
+
+/* Query whether the backlight is switched on, independent of the colors */
+static int fourzone_read_backlight(struct fourzone_priv *priv)
+{
+	u8 state[4] = { 0 };
+	int ret;
+
+	hp_wmi_begin();
+	ret = hp_wmi_perform_query(HPWMI_STATUS, HPWMI_FOURZONE,
+														 state, sizeof(state), sizeof(state));
+	hp_wmi_end();
+	if (ret)
+		return ret <= 0 ? ret : -EINVAL;
+
+	WRITE_ONCE(priv->backlight_off, state[0] == HPWMI_BACKLIGHT_OFF);
+	return 0;
 }
 
-static int fourzone_update_led(struct platform_zone *zone, enum hp_wmi_command rw)
+/* Refresh the shadow buffer and zone colors with a single firmware read */
+static int fourzone_read_state(struct fourzone_priv *priv)
 {
-	u8 state[128];
-	int ret = hp_wmi_perform_query(HPWMI_FOURZONE_COLOR_GET, HPWMI_FOURZONE,
-																 &state, sizeof(state), sizeof(state));
+	int ret;
+
+	hp_wmi_begin();
+	ret = hp_wmi_perform_query(HPWMI_FOURZONE_COLOR_GET, HPWMI_FOURZONE,
+														 priv->fw_state, sizeof(priv->fw_state),
+														 sizeof(priv->fw_state));
+	hp_wmi_end();
+	priv->fw_stale = ret != 0;
 	if (ret)
 	{
 		pr_warn("fourzone_color_get returned error 0x%x\n", ret);
 		return ret <= 0 ? ret : -EINVAL;
 	}
 
-	if (rw == HPWMI_WRITE)
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
 	{
-		state[zone->offset + 0] = zone->colors.red;
-		state[zone->offset + 1] = zone->colors.green;
-		state[zone->offset + 2] = zone->colors.blue;
+		u8 *color = &priv->fw_state[priv->zone_data[zone].offset];
 
-		ret = hp_wmi_perform_query(HPWMI_FOURZONE_COLOR_SET, HPWMI_FOURZONE,
-															 &state, sizeof(state), sizeof(state));
-		if (ret)
-			pr_warn("fourzone_color_set returned error 0x%x\n", ret);
-		return ret;
+		priv->zone_data[zone].colors.red = color[0];
+		priv->zone_data[zone].colors.green = color[1];
+		priv->zone_data[zone].colors.blue = color[2];
 	}
-	else
+	return 0;
+}
+
+/* Patch zone_data into the shadow buffer, returns whether anything changed */
+static bool fourzone_shadow_update(struct fourzone_priv *priv)
+{
+	bool changed = false;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
 	{
-		zone->colors.red = state[zone->offset + 0];
-		zone->colors.green = state[zone->offset + 1];
-		zone->colors.blue = state[zone->offset + 2];
+		u8 *color = &priv->fw_state[priv->zone_data[zone].offset];
+
+		changed |= color[0] != priv->zone_data[zone].colors.red ||
+							 color[1] != priv->zone_data[zone].colors.green ||
+							 color[2] != priv->zone_data[zone].colors.blue;
+		color[0] = priv->zone_data[zone].colors.red;
+		color[1] = priv->zone_data[zone].colors.green;
+		color[2] = priv->zone_data[zone].colors.blue;
 	}
-	return 0;
+
+	return changed;
+}
+
+/*
+ * Write all zones to the hardware at once. The shadow buffer stands in for
+ * the GET the per-zone path needs, so a whole frame costs one firmware call.
+ */
+static int fourzone_commit(struct fourzone_priv *priv)
+{
+	u8 state[FOURZONE_STATE_SIZE];
+	int ret;
+
+	/* The hardware already shows this frame */
+	if (!fourzone_shadow_update(priv) && !priv->fw_stale)
+		return 0;
+
+	/* The query overwrites its buffer with the reply, keep the shadow intact */
+	memcpy(state, priv->fw_state, sizeof(state));
+	hp_wmi_begin();
+	ret = hp_wmi_perform_query(HPWMI_FOURZONE_COLOR_SET, HPWMI_FOURZONE,
+														 state, sizeof(state), sizeof(state));
+	hp_wmi_end();
+	/* Don't trust the shadow until a write went through */
+	priv->fw_stale = ret != 0;
+	if (ret)
+		pr_warn("fourzone_color_set returned error 0x%x\n", ret);
+	return ret;
 }
 
 static ssize_t zone_show(struct device *dev, struct device_attribute *attr,
 												 char *buf)
 {
-	struct platform_zone *target_zone = match_zone(attr);
-	int ret;
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct platform_zone *target_zone = match_zone(priv, attr);
+	struct fourzone_config cfg;
+	struct color_platform *color;
 	if (target_zone == NULL)
 		return sprintf(buf, "red: -1, green: -1, blue: -1\n");
-	ret = fourzone_update_led(target_zone, HPWMI_READ);
-	if (ret)
-		return sprintf(buf, "red: -1, green: -1, blue: -1\n");
-	return sprintf(buf, "#%02x%02x%02x\n",
-							 target_zone->colors.red,
-							 target_zone->colors.green, target_zone->colors.blue);
+
+	/* The color as set, displayed and hw_readback show what the keyboard shows */
+	fourzone_config_get(priv, &cfg);
+	color = &cfg.colors[target_zone - priv->zone_data];
+	return sprintf(buf, "#%02x%02x%02x\n", color->red, color->green, color->blue);
 }
 
 static ssize_t zone_set(struct device *dev, struct device_attribute *attr,
 												const char *buf, size_t count)
 {
-	struct platform_zone *target_zone = match_zone(attr);
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct platform_zone *target_zone = match_zone(priv, attr);
+	struct platform_zone temp;
 	int ret;
 	if (target_zone == NULL)
 	{
 		pr_err("hp-wmi: invalid target zone\n");
-		return 1;
+		return -EINVAL;
 	}
-	ret = parse_rgb(buf, target_zone);
+	ret = parse_rgb(buf, &temp);
 	if (ret)
 		return ret;
 
-	int zone_idx = target_zone - zone_data;
-	original_colors[zone_idx].colors.red = target_zone->colors.red;
-	original_colors[zone_idx].colors.green = target_zone->colors.green;
-	original_colors[zone_idx].colors.blue = target_zone->colors.blue;
-
-	stop_animation();
-	current_animation = ANIMATION_STATIC;
+	int zone_idx = target_zone - priv->zone_data;
+	unsigned long flags;
 
-	target_zone->colors.red = (target_zone->colors.red * global_brightness) / 100;
-	target_zone->colors.green = (target_zone->colors.green * global_brightness) / 100;
-	target_zone->colors.blue = (target_zone->colors.blue * global_brightness) / 100;
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	priv->config.colors[zone_idx] = temp.colors;
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+	fourzone_led_sync(priv);
 
-	ret = fourzone_update_led(target_zone, HPWMI_WRITE);
-	if (ret)
-		return ret;
+	/* Effects of the zone pick the new color up, a static zone shows it */
+	schedule_work(&priv->animation_work);
 	
 	/* Save state */
-	save_animation_state();
+	save_animation_state(priv);
 	
 	return count;
 }
@@ -366,46 +1008,37 @@ static ssize_t zone_set(struct device *dev, struct device_attribute *attr,
 static ssize_t brightness_show(struct device *dev, struct device_attribute *attr,
 															 char *buf)
 {
-	return sprintf(buf, "%d\n", global_brightness);
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", READ_ONCE(priv->config.brightness));
 }
 
 static ssize_t brightness_set(struct device *dev, struct device_attribute *attr,
 															const char *buf, size_t count)
 {
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
 	unsigned long level;
-	int ret;
+	unsigned long flags;
 
 	if (kstrtoul(buf, 10, &level))
 		return -EINVAL;
 	if (level > 100)
 		level = 100;
 
-	global_brightness = level;
-
-	for (int zone = 0; zone < ZONE_COUNT; zone++)
-	{
-		/* Read current colors from hardware */
-		ret = fourzone_update_led(&zone_data[zone], HPWMI_READ);
-		if (ret)
-			return ret;
-
-		/* Store the original colors */
-		original_colors[zone].colors.red = zone_data[zone].colors.red;
-		original_colors[zone].colors.green = zone_data[zone].colors.green;
-		original_colors[zone].colors.blue = zone_data[zone].colors.blue;
+	/*
+	 * Brightness only scales the output, the base colors stay untouched so
+	 * changes never compound. The frame worker rebuilds its palette.
+	 */
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	priv->config.brightness = level;
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
 
-		/* Scale the colors by brightness */
-		zone_data[zone].colors.red = (zone_data[zone].colors.red * level) / 100;
-		zone_data[zone].colors.green = (zone_data[zone].colors.green * level) / 100;
-		zone_data[zone].colors.blue = (zone_data[zone].colors.blue * level) / 100;
-
-		ret = fourzone_update_led(&zone_data[zone], HPWMI_WRITE);
-		if (ret)
-			return ret;
-	}
+	fourzone_led_sync(priv);
+	animation_kick(priv);
 
 	/* Save state */
-	save_animation_state();
+	save_animation_state(priv);
 
 	return count;
 }
@@ -413,136 +1046,588 @@ static ssize_t brightness_set(struct device *dev, struct device_attribute *attr,
 static DEVICE_ATTR(brightness, 0644, brightness_show, brightness_set);
 
 /* Animation helper functions */
-static void apply_brightness_to_color(struct color_platform *color)
-{
-	color->red = (color->red * global_brightness) / 100;
-	color->green = (color->green * global_brightness) / 100;
-	color->blue = (color->blue * global_brightness) / 100;
-}
+#define PALETTE_SCALE_SHIFT 16
 
-static void hsv_to_rgb(int h, int s, int v, struct color_platform *rgb)
+/* Scale an 8-bit color by a Q16 factor into the 16-bit output range */
+static void color_widen(struct color16 *out, const struct color_platform *in, u32 scale)
 {
-	int c = (v * s) / 100;
-	int x = c * (60 - abs((h % 120) - 60)) / 60;
-	int m = v - c;
-	
-	int r, g, b;
-	
-	if (h < 60) {
-		r = c; g = x; b = 0;
-	} else if (h < 120) {
-		r = x; g = c; b = 0;
-	} else if (h < 180) {
-		r = 0; g = c; b = x;
-	} else if (h < 240) {
-		r = 0; g = x; b = c;
-	} else if (h < 300) {
-		r = x; g = 0; b = c;
-	} else {
-		r = c; g = 0; b = x;
-	}
-	
-	rgb->red = (r + m) * 255 / 100;
-	rgb->green = (g + m) * 255 / 100;
-	rgb->blue = (b + m) * 255 / 100;
+	out->red = (in->red * 257 * scale) >> PALETTE_SCALE_SHIFT;
+	out->green = (in->green * 257 * scale) >> PALETTE_SCALE_SHIFT;
+	out->blue = (in->blue * 257 * scale) >> PALETTE_SCALE_SHIFT;
 }
 
-static void update_all_zones_with_colors(struct color_platform colors[ZONE_COUNT])
+/* Bring the palette in line with the frame about to be rendered */
+static void fourzone_palette_refresh(struct fourzone_priv *priv)
 {
+	struct fourzone_palette *pal = &priv->palette;
+	int brightness = min(priv->frame.brightness, READ_ONCE(priv->brightness_cap));
+
+	if (pal->valid && pal->brightness == brightness && pal->level == priv->frame.level &&
+	    !memcmp(pal->gain, priv->frame.gain, sizeof(pal->gain)) &&
+	    !memcmp(pal->base, priv->frame.colors, sizeof(pal->base)))
+		return;
+
+	pal->brightness = brightness;
+	pal->level = priv->frame.level;
+	memcpy(pal->gain, priv->frame.gain, sizeof(pal->gain));
+	memcpy(pal->base, priv->frame.colors, sizeof(pal->base));
 	for (int zone = 0; zone < ZONE_COUNT; zone++) {
-		zone_data[zone].colors = colors[zone];
-		apply_brightness_to_color(&zone_data[zone].colors);
-		fourzone_update_led(&zone_data[zone], HPWMI_WRITE);
+		u64 level = (u64)pal->gain[zone] * pal->level * brightness;
+
+		pal->scale[zone] = DIV_ROUND_CLOSEST_ULL(level << PALETTE_SCALE_SHIFT,
+							 LED_FULL * LED_FULL * 100);
+		color_widen(&pal->colors[zone], &pal->base[zone], pal->scale[zone]);
 	}
+	pal->valid = true;
 }
 
-/* Animation implementations */
-static void animation_breathing(void)
+static void scale_color(struct color_platform *color, int intensity)
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(2000 / animation_speed); /* 2 second cycle */
-	unsigned long cycle_pos = elapsed % cycle_time;
-	
-	int angle = (360 * cycle_pos) / cycle_time;
-	int intensity = 50 + (50 * simple_sin(angle)) / 100;
-	
-	struct color_platform colors[ZONE_COUNT];
-	for (int zone = 0; zone < ZONE_COUNT; zone++) {
-		colors[zone] = original_colors[zone].colors;
-		colors[zone].red = (colors[zone].red * intensity) / 100;
-		colors[zone].green = (colors[zone].green * intensity) / 100;
-		colors[zone].blue = (colors[zone].blue * intensity) / 100;
-	}
-	
-	update_all_zones_with_colors(colors);
+	color->red = (color->red * intensity) / 100;
+	color->green = (color->green * intensity) / 100;
+	color->blue = (color->blue * intensity) / 100;
 }
 
-static void animation_rainbow(void)
+/*
+ * OKLab in fixed point. Hue sweeps, gradients and transitions interpolate
+ * here instead of in RGB or HSV, so midpoints keep their lightness and
+ * chroma instead of going muddy and equal steps look like equal changes.
+ * Components are Q16, L runs from 0 (black) to 65536 (white). Colors are
+ * taken as sRGB, conversions go through the tables below.
+ */
+struct oklab_stop
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(3000 / animation_speed); /* 3 second cycle */
-	unsigned long cycle_pos = elapsed % cycle_time;
-	
-	struct color_platform colors[ZONE_COUNT];
+	u16 pos;		/* Position along the gradient, 0 - 4096 */
+	struct oklab lab;
+};
+
+/* Sampled at i / 256 and read with lut_interp(), 65535 is full scale */
+static const u16 srgb_to_linear[257] = {
+	    0,    20,    40,    59,    79,    99,   119,   139,   159,   178,   198,   218,
+	  240,   263,   286,   312,   338,   365,   394,   424,   456,   489,   523,   558,
+	  595,   633,   673,   714,   756,   800,   845,   892,   940,   990,  1041,  1094,
+	 1148,  1204,  1262,  1320,  1381,  1443,  1507,  1572,  1639,  1707,  1778,  1849,
+	 1923,  1998,  2075,  2154,  2234,  2316,  2400,  2485,  2572,  2661,  2752,  2845,
+	 2939,  3035,  3133,  3233,  3334,  3438,  3543,  3650,  3759,  3870,  3982,  4097,
+	 4214,  4332,  4452,  4575,  4699,  4825,  4953,  5083,  5215,  5349,  5485,  5623,
+	 5763,  5906,  6050,  6196,  6344,  6494,  6646,  6800,  6957,  7115,  7276,  7438,
+	 7603,  7770,  7939,  8110,  8283,  8458,  8636,  8816,  8997,  9181,  9367,  9556,
+	 9746,  9939, 10134, 10331, 10530, 10732, 10936, 11142, 11350, 11561, 11773, 11988,
+	12206, 12425, 12647, 12872, 13098, 13327, 13558, 13791, 14027, 14265, 14506, 14749,
+	14994, 15241, 15491, 15743, 15998, 16255, 16514, 16776, 17041, 17307, 17576, 17848,
+	18122, 18398, 18677, 18958, 19242, 19528, 19816, 20108, 20401, 20697, 20996, 21297,
+	21600, 21906, 22215, 22526, 22840, 23156, 23474, 23796, 24119, 24446, 24775, 25106,
+	25440, 25777, 26116, 26458, 26802, 27149, 27499, 27851, 28206, 28563, 28923, 29286,
+	29651, 30019, 30390, 30763, 31139, 31518, 31899, 32283, 32670, 33059, 33451, 33846,
+	34243, 34644, 35046, 35452, 35860, 36271, 36685, 37102, 37521, 37943, 38368, 38795,
+	39226, 39659, 40095, 40533, 40975, 41419, 41866, 42316, 42768, 43224, 43682, 44143,
+	44607, 45073, 45543, 46015, 46491, 46969, 47450, 47934, 48420, 48910, 49402, 49897,
+	50396, 50897, 51401, 51908, 52417, 52930, 53446, 53964, 54486, 55010, 55537, 56067,
+	56601, 57137, 57676, 58218, 58763, 59311, 59862, 60415, 60972, 61532, 62095, 62661,
+	63230, 63801, 64376, 64954, 65535,
+};
+
+static const u16 linear_to_srgb[257] = {
+	    0,  3255,  5552,  7237,  8618,  9809, 10867, 11827, 12710, 13531, 14300, 15025,
+	15713, 16368, 16995, 17595, 18173, 18730, 19269, 19790, 20295, 20786, 21263, 21728,
+	22181, 22624, 23056, 23478, 23892, 24297, 24694, 25083, 25465, 25840, 26209, 26571,
+	26927, 27278, 27623, 27963, 28298, 28627, 28953, 29273, 29590, 29902, 30210, 30515,
+	30815, 31112, 31406, 31696, 31983, 32266, 32547, 32824, 33099, 33370, 33639, 33906,
+	34169, 34430, 34689, 34945, 35199, 35450, 35699, 35947, 36191, 36434, 36675, 36914,
+	37151, 37385, 37619, 37850, 38079, 38307, 38533, 38757, 38980, 39201, 39420, 39638,
+	39854, 40069, 40282, 40494, 40705, 40914, 41122, 41328, 41533, 41737, 41939, 42141,
+	42341, 42539, 42737, 42934, 43129, 43323, 43516, 43708, 43899, 44089, 44277, 44465,
+	44652, 44837, 45022, 45206, 45388, 45570, 45751, 45931, 46110, 46288, 46465, 46642,
+	46817, 46992, 47166, 47339, 47511, 47682, 47853, 48023, 48192, 48360, 48527, 48694,
+	48860, 49025, 49190, 49354, 49517, 49679, 49841, 50002, 50162, 50322, 50481, 50639,
+	50797, 50954, 51111, 51266, 51422, 51576, 51730, 51884, 52036, 52189, 52340, 52491,
+	52642, 52792, 52941, 53090, 53238, 53386, 53533, 53680, 53826, 53972, 54117, 54262,
+	54406, 54549, 54693, 54835, 54977, 55119, 55260, 55401, 55541, 55681, 55820, 55959,
+	56098, 56236, 56373, 56510, 56647, 56783, 56919, 57054, 57189, 57324, 57458, 57592,
+	57725, 57858, 57990, 58122, 58254, 58385, 58516, 58647, 58777, 58907, 59036, 59165,
+	59294, 59422, 59550, 59678, 59805, 59932, 60058, 60184, 60310, 60435, 60561, 60685,
+	60810, 60934, 61058, 61181, 61304, 61427, 61549, 61671, 61793, 61915, 62036, 62157,
+	62277, 62398, 62518, 62637, 62757, 62876, 62994, 63113, 63231, 63349, 63466, 63584,
+	63701, 63817, 63934, 64050, 64166, 64281, 64397, 64512, 64626, 64741, 64855, 64969,
+	65083, 65196, 65309, 65422, 65535,
+};
+
+static const u16 cbrt_lut[257] = {
+	    0, 10321, 13004, 14886, 16384, 17649, 18755, 19744, 20642, 21469, 22236, 22954,
+	23629, 24268, 24875, 25454, 26008, 26538, 27049, 27541, 28016, 28475, 28920, 29352,
+	29771, 30179, 30576, 30963, 31341, 31710, 32070, 32423, 32768, 33105, 33436, 33761,
+	34080, 34392, 34699, 35001, 35298, 35589, 35876, 36159, 36437, 36711, 36981, 37247,
+	37509, 37768, 38023, 38275, 38524, 38769, 39011, 39251, 39487, 39721, 39952, 40180,
+	40406, 40629, 40850, 41068, 41284, 41498, 41710, 41920, 42127, 42333, 42536, 42738,
+	42938, 43135, 43332, 43526, 43718, 43909, 44099, 44286, 44472, 44657, 44840, 45021,
+	45202, 45380, 45557, 45733, 45908, 46081, 46253, 46424, 46593, 46761, 46928, 47094,
+	47259, 47422, 47585, 47746, 47906, 48066, 48224, 48381, 48537, 48692, 48846, 48999,
+	49151, 49302, 49453, 49602, 49751, 49898, 50045, 50191, 50336, 50480, 50624, 50766,
+	50908, 51049, 51189, 51329, 51468, 51606, 51743, 51879, 52015, 52150, 52285, 52418,
+	52551, 52684, 52816, 52947, 53077, 53207, 53336, 53464, 53592, 53720, 53846, 53972,
+	54098, 54223, 54347, 54471, 54594, 54717, 54839, 54961, 55082, 55202, 55322, 55442,
+	55561, 55679, 55797, 55915, 56032, 56148, 56264, 56380, 56495, 56609, 56723, 56837,
+	56950, 57063, 57175, 57287, 57399, 57510, 57620, 57731, 57840, 57950, 58059, 58167,
+	58275, 58383, 58490, 58597, 58704, 58810, 58916, 59021, 59126, 59231, 59335, 59439,
+	59542, 59646, 59749, 59851, 59953, 60055, 60156, 60257, 60358, 60459, 60559, 60659,
+	60758, 60857, 60956, 61054, 61153, 61250, 61348, 61445, 61542, 61639, 61735, 61831,
+	61927, 62022, 62117, 62212, 62307, 62401, 62495, 62589, 62682, 62775, 62868, 62961,
+	63053, 63145, 63237, 63328, 63419, 63510, 63601, 63692, 63782, 63872, 63962, 64051,
+	64140, 64229, 64318, 64406, 64495, 64583, 64670, 64758, 64845, 64932, 65019, 65106,
+	65192, 65278, 65364, 65450, 65535,
+};
+
+/* Stops spaced by their OKLab distance, so the sweep runs at an even pace */
+static const struct oklab_stop rainbow_stops[] = {
+	{    0, {  41154,  14737,   8247 } },	/* #ff0000 */
+	{  867, {  63438,  -4677,  13013 } },	/* #ffff00 */
+	{ 1233, {  56783, -15328,  11764 } },	/* #00ff00 */
+	{ 1684, {  59336,  -9794,  -2582 } },	/* #00ffff */
+	{ 2713, {  29623,  -2127, -20416 } },	/* #0000ff */
+	{ 3511, {  45985,  17994, -11086 } },	/* #ff00ff */
+	{ 4096, {  41154,  14737,   8247 } },	/* #ff0000 */
+};
+
+static const struct oklab_stop heat_stops[] = {
+	{    0, {  29623,  -2127, -20416 } },	/* #0000ff */
+	{ 1553, {  59336,  -9794,  -2582 } },	/* #00ffff */
+	{ 2234, {  56783, -15328,  11764 } },	/* #00ff00 */
+	{ 2786, {  63438,  -4677,  13013 } },	/* #ffff00 */
+	{ 4096, {  41154,  14737,   8247 } },	/* #ff0000 */
+};
+/* Matrices from the OKLab definition, Q14 */
+static const s32 oklab_m1[3][3] = {
+	{ 6754, 8787, 843 },
+	{ 3472, 11153, 1760 },
+	{ 1447, 4616, 10322 },
+};
+
+static const s32 oklab_m2[3][3] = {
+	{ 3448, 13003, -67 },
+	{ 32408, -39790, 7383 },
+	{ 424, 12825, -13249 },
+};
+
+static const s32 oklab_m2_inv[3][3] = {
+	{ 16384, 6494, 3536 },
+	{ 16384, -1730, -1046 },
+	{ 16384, -1466, -21160 },
+};
+
+static const s32 oklab_m1_inv[3][3] = {
+	{ 66793, -54194, 3784 },
+	{ -20782, 42758, -5592 },
+	{ -69, -11525, 27978 },
+};
+
+static u16 lut_interp(const u16 *table, u16 v)
+{
+	unsigned int i = v >> 8;
+	unsigned int frac = v & 0xff;
+
+	return table[i] + (((table[i + 1] - table[i]) * frac) >> 8);
+}
+
+static void mat3_apply(const s32 m[3][3], const s32 in[3], s32 out[3])
+{
+	for (int i = 0; i < 3; i++)
+		out[i] = ((s64)m[i][0] * in[0] + (s64)m[i][1] * in[1] +
+			  (s64)m[i][2] * in[2] + (1 << 13)) >> 14;
+}
+
+static s32 oklab_cbrt(s32 x)
+{
+	int shift = 0;
+
+	if (x <= 0)
+		return 0;
+	x = min(x, 65535);
+	/* cbrt(x * 8^k) = cbrt(x) * 2^k, look up where the curve is flat */
+	while (x < 1 << 13) {
+		x <<= 3;
+		shift++;
+	}
+	return lut_interp(cbrt_lut, x) >> shift;
+}
+
+static void rgb16_to_oklab(const struct color16 *color, struct oklab *lab)
+{
+	s32 rgb[3] = {
+		lut_interp(srgb_to_linear, color->red),
+		lut_interp(srgb_to_linear, color->green),
+		lut_interp(srgb_to_linear, color->blue),
+	};
+	s32 lms[3], out[3];
+
+	mat3_apply(oklab_m1, rgb, lms);
+	for (int i = 0; i < 3; i++)
+		lms[i] = oklab_cbrt(lms[i]);
+	mat3_apply(oklab_m2, lms, out);
+
+	lab->l = out[0];
+	lab->a = out[1];
+	lab->b = out[2];
+}
+
+static void oklab_to_rgb16(const struct oklab *lab, struct color16 *color)
+{
+	s32 in[3] = { lab->l, lab->a, lab->b };
+	s32 lms[3], rgb[3];
+
+	mat3_apply(oklab_m2_inv, in, lms);
+	/* Four extra bits through the cube, oklab_m1_inv amplifies rounding */
+	for (int i = 0; i < 3; i++)
+		lms[i] = ((s64)lms[i] * lms[i] * lms[i]) >> 28;
+	mat3_apply(oklab_m1_inv, lms, rgb);
+	for (int i = 0; i < 3; i++)
+		rgb[i] = clamp((rgb[i] + 8) >> 4, 0, 65535);
+
+	color->red = lut_interp(linear_to_srgb, rgb[0]);
+	color->green = lut_interp(linear_to_srgb, rgb[1]);
+	color->blue = lut_interp(linear_to_srgb, rgb[2]);
+}
+
+/* t runs from 0 (from) to 4096 (to) */
+static void oklab_lerp(const struct oklab *from, const struct oklab *to,
+		       int t, struct oklab *out)
+{
+	out->l = from->l + (((s64)(to->l - from->l) * t) >> 12);
+	out->a = from->a + (((s64)(to->a - from->a) * t) >> 12);
+	out->b = from->b + (((s64)(to->b - from->b) * t) >> 12);
+}
+
+/* Color at pos (0 - 4096) along a gradient, as 8-bit sRGB */
+static void oklab_gradient(const struct oklab_stop *stops, int count,
+			   unsigned int pos, struct color_platform *rgb)
+{
+	struct color16 wide;
+	struct oklab lab;
+	int i = 1;
+
+	while (i < count - 1 && pos > stops[i].pos)
+		i++;
+	pos = clamp(pos, stops[i - 1].pos, stops[i].pos);
+	oklab_lerp(&stops[i - 1].lab, &stops[i].lab,
+		   (pos - stops[i - 1].pos) * 4096 / (stops[i].pos - stops[i - 1].pos), &lab);
+	oklab_to_rgb16(&lab, &wide);
+
+	rgb->red = (wide.red - (wide.red >> 8) + 128) >> 8;
+	rgb->green = (wide.green - (wide.green >> 8) + 128) >> 8;
+	rgb->blue = (wide.blue - (wide.blue >> 8) + 128) >> 8;
+}
+
+/*
+ * White balance calibration. Each zone has a 3x3 matrix in Q10 applied to
+ * the linear color, so both per-channel gains (the diagonal) and crosstalk
+ * between channels can be corrected. Zones left at identity are skipped.
+ */
+#define CALIB_SHIFT 10
+#define CALIB_ONE (1 << CALIB_SHIFT)
+#define CALIB_MAX (4 * CALIB_ONE)
+
+static const s16 calib_identity[9] = {
+	CALIB_ONE, 0, 0,
+	0, CALIB_ONE, 0,
+	0, 0, CALIB_ONE,
+};
+
+static u16 calib_channel(const s16 row[3], const struct color16 *color)
+{
+	int v = row[0] * color->red + row[1] * color->green + row[2] * color->blue;
+
+	return clamp((v + CALIB_ONE / 2) >> CALIB_SHIFT, 0, 65535);
+}
+
+static void fourzone_calibrate(struct color16 *color, const s16 m[9])
+{
+	struct color16 in = *color;
+
+	color->red = calib_channel(&m[0], &in);
+	color->green = calib_channel(&m[3], &in);
+	color->blue = calib_channel(&m[6], &in);
+}
+
+/* Recompute the identity skip mask, config_lock held or config private */
+static void calib_update_mask(struct fourzone_config *cfg)
+{
+	cfg->calibrated = 0;
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		if (memcmp(cfg->calib[zone], calib_identity, sizeof(calib_identity)))
+			cfg->calibrated |= BIT(zone);
+}
+
+static bool calib_valid(const s16 m[9])
+{
+	for (int i = 0; i < 9; i++)
+		if (m[i] < -CALIB_MAX || m[i] > CALIB_MAX)
+			return false;
+	return true;
+}
+
+/*
+ * Gamma tables, round(65535 * (i / 256)^gamma), looked up with linear
+ * interpolation. Effects and brightness work on linear values, the curve is
+ * the last step before the firmware so fades look even instead of jumping at
+ * the dark end.
+ */
+static const u16 gamma_1_8[257] = {
+	    0,     3,    11,    22,    37,    55,    76,   101,   128,   158,   191,   227,
+	  266,   307,   350,   397,   446,   497,   551,   607,   666,   727,   791,   857,
+	  925,   995,  1068,  1143,  1220,  1300,  1382,  1466,  1552,  1640,  1731,  1824,
+	 1919,  2016,  2115,  2216,  2319,  2425,  2532,  2642,  2753,  2867,  2983,  3100,
+	 3220,  3342,  3466,  3591,  3719,  3849,  3981,  4114,  4250,  4387,  4527,  4668,
+	 4812,  4957,  5104,  5254,  5405,  5558,  5712,  5869,  6028,  6188,  6351,  6515,
+	 6681,  6849,  7019,  7190,  7364,  7539,  7716,  7895,  8076,  8259,  8443,  8629,
+	 8817,  9007,  9199,  9392,  9588,  9785,  9983, 10184, 10386, 10590, 10796, 11004,
+	11213, 11424, 11637, 11852, 12068, 12286, 12506, 12728, 12951, 13176, 13403, 13631,
+	13861, 14093, 14327, 14562, 14799, 15038, 15278, 15520, 15764, 16009, 16257, 16505,
+	16756, 17008, 17262, 17517, 17775, 18033, 18294, 18556, 18820, 19085, 19353, 19621,
+	19892, 20164, 20438, 20713, 20990, 21269, 21549, 21831, 22114, 22399, 22686, 22975,
+	23265, 23556, 23849, 24144, 24441, 24739, 25038, 25340, 25642, 25947, 26253, 26561,
+	26870, 27181, 27493, 27807, 28123, 28440, 28759, 29079, 29401, 29724, 30049, 30376,
+	30704, 31034, 31365, 31698, 32033, 32369, 32706, 33045, 33386, 33728, 34072, 34417,
+	34764, 35113, 35463, 35814, 36167, 36522, 36878, 37235, 37595, 37955, 38318, 38681,
+	39047, 39413, 39782, 40152, 40523, 40896, 41270, 41646, 42024, 42403, 42783, 43165,
+	43549, 43934, 44320, 44708, 45098, 45489, 45881, 46275, 46671, 47068, 47466, 47866,
+	48268, 48671, 49075, 49481, 49889, 50298, 50708, 51120, 51533, 51948, 52364, 52782,
+	53202, 53622, 54044, 54468, 54893, 55320, 55748, 56178, 56609, 57041, 57475, 57911,
+	58347, 58786, 59226, 59667, 60109, 60554, 60999, 61446, 61895, 62345, 62796, 63249,
+	63703, 64159, 64616, 65075, 65535,
+};
+
+static const u16 gamma_2_2[257] = {
+	    0,     0,     2,     4,     7,    11,    17,    24,    32,    41,    52,    64,
+	   78,    93,   110,   128,   147,   168,   191,   215,   240,   267,   296,   327,
+	  359,   392,   428,   465,   504,   544,   586,   630,   676,   723,   772,   823,
+	  875,   930,   986,  1044,  1104,  1165,  1229,  1294,  1361,  1430,  1501,  1574,
+	 1648,  1725,  1803,  1884,  1966,  2050,  2136,  2224,  2314,  2406,  2500,  2595,
+	 2693,  2793,  2895,  2998,  3104,  3212,  3322,  3433,  3547,  3663,  3781,  3900,
+	 4022,  4146,  4272,  4400,  4530,  4663,  4797,  4933,  5072,  5212,  5355,  5499,
+	 5646,  5795,  5946,  6099,  6255,  6412,  6572,  6733,  6897,  7063,  7231,  7402,
+	 7574,  7749,  7926,  8105,  8286,  8469,  8655,  8843,  9033,  9225,  9419,  9616,
+	 9815, 10016, 10219, 10425, 10632, 10842, 11054, 11269, 11486, 11705, 11926, 12149,
+	12375, 12603, 12833, 13066, 13301, 13538, 13777, 14019, 14263, 14509, 14758, 15009,
+	15262, 15517, 15775, 16035, 16298, 16563, 16830, 17099, 17371, 17645, 17922, 18201,
+	18482, 18765, 19051, 19339, 19630, 19923, 20218, 20516, 20816, 21119, 21424, 21731,
+	22040, 22352, 22667, 22984, 23303, 23624, 23949, 24275, 24604, 24935, 25269, 25605,
+	25943, 26284, 26628, 26973, 27322, 27672, 28026, 28381, 28739, 29100, 29462, 29828,
+	30196, 30566, 30939, 31314, 31692, 32072, 32454, 32840, 33227, 33617, 34010, 34405,
+	34802, 35202, 35605, 36010, 36417, 36827, 37240, 37655, 38072, 38493, 38915, 39340,
+	39768, 40198, 40631, 41066, 41503, 41944, 42387, 42832, 43280, 43730, 44183, 44639,
+	45097, 45557, 46020, 46486, 46954, 47425, 47899, 48374, 48853, 49334, 49818, 50304,
+	50793, 51284, 51778, 52275, 52774, 53276, 53780, 54287, 54796, 55308, 55823, 56341,
+	56860, 57383, 57908, 58436, 58966, 59499, 60035, 60573, 61114, 61657, 62203, 62752,
+	63303, 63857, 64414, 64973, 65535,
+};
+
+static const u16 gamma_2_6[257] = {
+	    0,     0,     0,     1,     1,     2,     4,     6,     8,    11,    14,    18,
+	   23,    28,    34,    41,    49,    57,    66,    76,    87,    98,   111,   125,
+	  139,   155,   171,   189,   208,   228,   249,   271,   294,   319,   344,   371,
+	  399,   429,   460,   492,   525,   560,   596,   634,   673,   714,   755,   799,
+	  844,   890,   938,   988,  1039,  1092,  1146,  1202,  1260,  1319,  1380,  1443,
+	 1507,  1574,  1642,  1711,  1783,  1856,  1931,  2008,  2087,  2168,  2251,  2335,
+	 2422,  2510,  2600,  2693,  2787,  2884,  2982,  3082,  3185,  3289,  3396,  3505,
+	 3616,  3729,  3844,  3961,  4080,  4202,  4326,  4452,  4580,  4711,  4844,  4979,
+	 5116,  5256,  5398,  5542,  5689,  5838,  5990,  6144,  6300,  6459,  6620,  6783,
+	 6949,  7118,  7289,  7463,  7639,  7817,  7998,  8182,  8368,  8557,  8749,  8943,
+	 9139,  9339,  9541,  9745,  9953, 10163, 10376, 10591, 10809, 11030, 11254, 11480,
+	11710, 11942, 12176, 12414, 12655, 12898, 13144, 13393, 13645, 13900, 14158, 14419,
+	14682, 14949, 15218, 15491, 15766, 16045, 16326, 16611, 16898, 17189, 17482, 17779,
+	18079, 18382, 18688, 18997, 19309, 19624, 19943, 20265, 20589, 20917, 21249, 21583,
+	21921, 22262, 22606, 22953, 23304, 23658, 24015, 24375, 24739, 25106, 25477, 25850,
+	26228, 26608, 26992, 27379, 27770, 28164, 28562, 28963, 29367, 29775, 30186, 30601,
+	31019, 31441, 31866, 32295, 32728, 33164, 33603, 34046, 34493, 34943, 35397, 35854,
+	36315, 36780, 37248, 37720, 38196, 38675, 39158, 39645, 40135, 40629, 41127, 41628,
+	42134, 42643, 43156, 43672, 44192, 44717, 45245, 45776, 46312, 46852, 47395, 47942,
+	48493, 49048, 49607, 50170, 50736, 51307, 51881, 52460, 53042, 53628, 54219, 54813,
+	55411, 56014, 56620, 57230, 57845, 58463, 59085, 59712, 60343, 60977, 61616, 62259,
+	62906, 63557, 64212, 64871, 65535,
+};
+
+static const char *const gamma_names[GAMMA_COUNT] = {
+	"linear", "1.8", "2.2", "2.6"
+};
+
+static const u16 *const gamma_tables[GAMMA_COUNT] = {
+	[GAMMA_1_8] = gamma_1_8,
+	[GAMMA_2_2] = gamma_2_2,
+	[GAMMA_2_6] = gamma_2_6,
+};
+
+/*
+ * Reduce a 16-bit channel to the 8 bits the firmware takes. Dithering adds
+ * the residue of the previous frame before truncating, so over a few frames
+ * the average matches the 16-bit value and slow fades at low brightness
+ * pass through the levels in between.
+ */
+static u8 output_channel(struct fourzone_priv *priv, u16 v, u8 *err)
+{
+	unsigned int q = v - (v >> 8);	/* 8-bit value in 8.8 fixed point */
+
+	if (!priv->dither_active) {
+		*err = 0;
+		return (q + 128) >> 8;
+	}
+
+	q += *err;
+	*err = q & 0xff;
+	return q >> 8;
+}
+
+/* Final stage of every frame, colors are already scaled by the palette */
+static int fourzone_present(struct fourzone_priv *priv,
+			    const struct color16 colors[ZONE_COUNT])
+{
+	const u16 *red = gamma_tables[priv->frame.gamma[0]];
+	const u16 *green = gamma_tables[priv->frame.gamma[1]];
+	const u16 *blue = gamma_tables[priv->frame.gamma[2]];
+	unsigned long flags;
+	int ret;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		struct color_platform *out = &priv->zone_data[zone].colors;
+		u8 *err = priv->dither_err[zone];
+		struct color16 color = colors[zone];
+
+		if (priv->transition_active) {
+			struct oklab to, mix;
+
+			rgb16_to_oklab(&color, &to);
+			oklab_lerp(&priv->transition_from[zone], &to, priv->transition_pos * 16, &mix);
+			oklab_to_rgb16(&mix, &color);
+		}
+		priv->rendered[zone] = color;
+
+		if (priv->frame.calibrated & BIT(zone))
+			fourzone_calibrate(&color, priv->frame.calib[zone]);
+		if (priv->output_level < 100) {
+			color.red = color.red * priv->output_level / 100;
+			color.green = color.green * priv->output_level / 100;
+			color.blue = color.blue * priv->output_level / 100;
+		}
+		if (red)
+			color.red = lut_interp(red, color.red);
+		if (green)
+			color.green = lut_interp(green, color.green);
+		if (blue)
+			color.blue = lut_interp(blue, color.blue);
+
+		out->red = output_channel(priv, color.red, &err[0]);
+		out->green = output_channel(priv, color.green, &err[1]);
+		out->blue = output_channel(priv, color.blue, &err[2]);
+	}
+
+	priv->rendered_valid = true;
+
+	ret = fourzone_commit(priv);
+	if (ret)
+		return ret;
+
+	/* Publish the frame for lock-free readers, see fourzone_snapshot() */
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		priv->displayed[zone] = priv->zone_data[zone].colors;
+	write_sequnlock_irqrestore(&priv->config_lock, flags);
+	return 0;
+}
+
+static int update_all_zones_with_colors(struct fourzone_priv *priv,
+					const struct color_platform colors[ZONE_COUNT])
+{
+	struct color16 out[ZONE_COUNT];
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		color_widen(&out[zone], &colors[zone], priv->palette.scale[zone]);
+
+	return fourzone_present(priv, out);
+}
+
+static int show_original_colors(struct fourzone_priv *priv)
+{
+	return fourzone_present(priv, priv->palette.colors);
+}
+
+/* Animation implementations */
+static void animation_breathing(struct fourzone_priv *priv, int speed,
+			struct color_platform colors[ZONE_COUNT])
+{
+	unsigned long elapsed = jiffies - priv->animation_start_time;
+	unsigned long cycle_time = msecs_to_jiffies(2000 / speed); /* 2 second cycle */
+	unsigned long cycle_pos = elapsed % cycle_time;
+	
+	int angle = (360 * cycle_pos) / cycle_time;
+	int intensity = 50 + (50 * simple_sin(angle)) / 100;
+	
 	for (int zone = 0; zone < ZONE_COUNT; zone++) {
-		int hue = (360 * cycle_pos / cycle_time + zone * 90) % 360;
-		hsv_to_rgb(hue, 100, 100, &colors[zone]);
+		colors[zone] = priv->frame.colors[zone];
+		colors[zone].red = (colors[zone].red * intensity) / 100;
+		colors[zone].green = (colors[zone].green * intensity) / 100;
+		colors[zone].blue = (colors[zone].blue * intensity) / 100;
 	}
+}
+
+static void animation_rainbow(struct fourzone_priv *priv, int speed,
+			struct color_platform colors[ZONE_COUNT])
+{
+	unsigned long elapsed = jiffies - priv->animation_start_time;
+	unsigned long cycle_time = msecs_to_jiffies(3000 / speed); /* 3 second cycle */
+	unsigned long cycle_pos = elapsed % cycle_time;
 	
-	update_all_zones_with_colors(colors);
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		unsigned int pos = (4096 * cycle_pos / cycle_time + zone * 1024) % 4096;
+
+		oklab_gradient(rainbow_stops, ARRAY_SIZE(rainbow_stops), pos, &colors[zone]);
+	}
 }
 
-static void animation_wave(void)
+static void animation_wave(struct fourzone_priv *priv, int speed,
+			struct color_platform colors[ZONE_COUNT])
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(2000 / animation_speed); /* 2 second cycle */
+	unsigned long elapsed = jiffies - priv->animation_start_time;
+	unsigned long cycle_time = msecs_to_jiffies(2000 / speed); /* 2 second cycle */
 	unsigned long cycle_pos = elapsed % cycle_time;
 	
-	struct color_platform colors[ZONE_COUNT];
 	for (int zone = 0; zone < ZONE_COUNT; zone++) {
 		int wave_pos = (cycle_pos * 4 / cycle_time + zone) % 4;
 		int angle = (360 * wave_pos) / 4;
 		int intensity = 30 + (70 * (100 + simple_sin(angle)) / 200);
 		
-		colors[zone] = original_colors[zone].colors;
+		colors[zone] = priv->frame.colors[zone];
 		colors[zone].red = (colors[zone].red * intensity) / 100;
 		colors[zone].green = (colors[zone].green * intensity) / 100;
 		colors[zone].blue = (colors[zone].blue * intensity) / 100;
 	}
-	
-	update_all_zones_with_colors(colors);
 }
 
-static void animation_pulse(void)
+static void animation_pulse(struct fourzone_priv *priv, int speed,
+			struct color_platform colors[ZONE_COUNT])
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(1500 / animation_speed); /* 1.5 second cycle */
+	unsigned long elapsed = jiffies - priv->animation_start_time;
+	unsigned long cycle_time = msecs_to_jiffies(1500 / speed); /* 1.5 second cycle */
 	unsigned long cycle_pos = elapsed % cycle_time;
 	
 	int angle = (360 * cycle_pos) / cycle_time;
 	int intensity = 20 + (80 * (100 + simple_sin(angle)) / 200);
 	
-	struct color_platform colors[ZONE_COUNT];
 	for (int zone = 0; zone < ZONE_COUNT; zone++) {
-		colors[zone] = original_colors[zone].colors;
+		colors[zone] = priv->frame.colors[zone];
 		colors[zone].red = (colors[zone].red * intensity) / 100;
 		colors[zone].green = (colors[zone].green * intensity) / 100;
 		colors[zone].blue = (colors[zone].blue * intensity) / 100;
 	}
-	
-	update_all_zones_with_colors(colors);
 }
 
-static void animation_chase(void)
+static void animation_chase(struct fourzone_priv *priv, int speed,
+			struct color_platform colors[ZONE_COUNT])
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(1200 / animation_speed); /* 1.2 second cycle */
+	unsigned long elapsed = jiffies - priv->animation_start_time;
+	unsigned long cycle_time = msecs_to_jiffies(1200 / speed); /* 1.2 second cycle */
 	unsigned long cycle_pos = elapsed % cycle_time;
 	
-	struct color_platform colors[ZONE_COUNT];
 	int active_zone = (cycle_pos * ZONE_COUNT) / cycle_time;
 	
-	struct color_platform base_color = original_colors[0].colors;
+	struct color_platform base_color = priv->frame.colors[0];
 	
 	for (int zone = 0; zone < ZONE_COUNT; zone++) {
 		if (zone == active_zone) {
@@ -554,23 +1639,86 @@ static void animation_chase(void)
 			colors[zone].blue = colors[zone].blue / 6;
 		}
 	}
-	
-	update_all_zones_with_colors(colors);
 }
 
-static void animation_sparkle(void)
+/*
+ * Randomness for effects. Every zone has its own xorshift32 state for
+ * events, and value noise gives smooth random curves over time. Both derive
+ * from one seed picked when the animation starts, a fixed seed makes the
+ * frames reproducible.
+ */
+static u32 noise_hash(u32 seed, u32 zone, u32 x)
+{
+	u32 h = seed ^ (zone * 0x9e3779b9) ^ (x * 0x85ebca6b);
+
+	h ^= h >> 16;
+	h *= 0x7feb352d;
+	h ^= h >> 15;
+	h *= 0x846ca68b;
+	h ^= h >> 16;
+	return h;
+}
+
+static void animation_reseed(struct fourzone_priv *priv)
+{
+	u32 seed = READ_ONCE(priv->seed);
+
+	priv->noise_seed = seed ?: get_random_u32();
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		priv->rng[zone] = noise_hash(priv->noise_seed, zone, 0) | 1;
+		priv->sparkle_at[zone] = jiffies - HZ;
+	}
+	priv->render_last = jiffies;
+}
+
+static u32 zone_rand(struct fourzone_priv *priv, int zone)
+{
+	u32 x = priv->rng[zone];
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	priv->rng[zone] = x;
+	return x;
+}
+
+/* Smooth 1D noise, t in lattice steps Q8, result 0 - 65535 */
+static u32 value_noise(u32 seed, u32 zone, u32 t)
+{
+	u32 x = t >> 8;
+	s32 f = t & 0xff;
+	s32 a = noise_hash(seed, zone, x) >> 16;
+	s32 b = noise_hash(seed, zone, x + 1) >> 16;
+
+	f = f * f * (3 * 256 - 2 * f) >> 16;	/* smoothstep */
+	return a + (((b - a) * f) >> 8);
+}
+
+/* Only draws for the zones in the group, their random state is their own */
+static void animation_sparkle(struct fourzone_priv *priv, int speed, u8 zones,
+			struct color_platform colors[ZONE_COUNT])
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(3000 / animation_speed);
+	unsigned long now = jiffies;
+	unsigned long cycle_time = msecs_to_jiffies(3000 / speed);
+	unsigned long sparkle_duration = max(cycle_time / 8, 1UL); /* Short sparkle duration */
+	/* One sparkle per cycle and zone on average, whatever the frame rate */
+	u32 chance = min_t(u64, (u64)U32_MAX * priv->render_dt / cycle_time, U32_MAX);
 	
-	struct color_platform colors[ZONE_COUNT];
-	struct color_platform base_color = original_colors[0].colors;
+	struct color_platform base_color = priv->frame.colors[0];
 	
 	for (int zone = 0; zone < ZONE_COUNT; zone++) {
-		int sparkle_offset = (elapsed + zone * 800) % cycle_time;
-		int sparkle_duration = cycle_time / 8; /* Short sparkle duration */
+		bool sparkling;
+
+		if (!(zones & BIT(zone)))
+			continue;
+
+		sparkling = now - priv->sparkle_at[zone] < sparkle_duration;
+		if (!sparkling && zone_rand(priv, zone) < chance) {
+			priv->sparkle_at[zone] = now;
+			sparkling = true;
+		}
 		
-		if (sparkle_offset < sparkle_duration) {
+		if (sparkling) {
 			colors[zone].red = 255;
 			colors[zone].green = 255;
 			colors[zone].blue = 255;
@@ -581,39 +1729,34 @@ static void animation_sparkle(void)
 			colors[zone].blue = colors[zone].blue / 8;
 		}
 	}
-	
-	update_all_zones_with_colors(colors);
 }
 
-static void animation_candle(void)
+static void animation_candle(struct fourzone_priv *priv, int speed,
+			struct color_platform colors[ZONE_COUNT])
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(100 / animation_speed); /* Fast flicker */
-	unsigned long cycle_pos = elapsed % cycle_time;
-	
-	struct color_platform colors[ZONE_COUNT];
+	unsigned long elapsed = jiffies - priv->animation_start_time;
+	/* Slow sway plus fast flicker, one lattice step per 400 / speed ms */
+	u32 t = div_u64((u64)jiffies_to_msecs(elapsed) * 256 * speed, 400);
 	
 	for (int zone = 0; zone < ZONE_COUNT; zone++) {
 		/* Candle flicker - warm colors with random intensity */
-		int flicker = (cycle_pos + zone * 500) % cycle_time;
-		int intensity = 60 + (40 * flicker) / cycle_time;
+		u32 sway = value_noise(priv->noise_seed, zone, t);
+		u32 flicker = value_noise(priv->noise_seed, zone + ZONE_COUNT, t * 4);
+		int intensity = 55 + (45 * ((2 * sway + flicker) / 3)) / 65535;
 		
 		colors[zone].red = (255 * intensity) / 100;
 		colors[zone].green = (150 * intensity) / 100;
 		colors[zone].blue = (50 * intensity) / 100;
 	}
-	
-	update_all_zones_with_colors(colors);
 }
 
-static void animation_aurora(void)
+static void animation_aurora(struct fourzone_priv *priv, int speed,
+			struct color_platform colors[ZONE_COUNT])
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(4000 / animation_speed); /* Slow aurora */
+	unsigned long elapsed = jiffies - priv->animation_start_time;
+	unsigned long cycle_time = msecs_to_jiffies(4000 / speed); /* Slow aurora */
 	unsigned long cycle_pos = elapsed % cycle_time;
 	
-	struct color_platform colors[ZONE_COUNT];
-	
 	for (int zone = 0; zone < ZONE_COUNT; zone++) {
 		int wave_pos = (cycle_pos * 2 + zone * 1000) % cycle_time;
 		int intensity = 30 + (70 * (100 + simple_sin((360 * wave_pos) / cycle_time)) / 200);
@@ -623,18 +1766,15 @@ static void animation_aurora(void)
 		colors[zone].green = (200 * intensity) / 100;
 		colors[zone].blue = (180 * intensity) / 100;
 	}
-	
-	update_all_zones_with_colors(colors);
 }
 
-static void animation_disco(void)
+static void animation_disco(struct fourzone_priv *priv, int speed,
+			struct color_platform colors[ZONE_COUNT])
 {
-	unsigned long elapsed = jiffies - animation_start_time;
-	unsigned long cycle_time = msecs_to_jiffies(300 / animation_speed); /* Fast strobe */
+	unsigned long elapsed = jiffies - priv->animation_start_time;
+	unsigned long cycle_time = msecs_to_jiffies(300 / speed); /* Fast strobe */
 	unsigned long cycle_pos = elapsed % cycle_time;
 	
-	struct color_platform colors[ZONE_COUNT];
-	
 	/* Disco strobe - bright colors that flash */
 	if (cycle_pos < cycle_time / 2) {
 		/* Flash on */
@@ -655,26 +1795,232 @@ static void animation_disco(void)
 			colors[zone].blue = 0;
 		}
 	}
-	
-	update_all_zones_with_colors(colors);
+}
+
+/*
+ * Reactive effects. Zone layout: zone 0 right, zone 1 middle, zone 2 left,
+ * zone 3 WASD. key_zone[] holds zone + 1, 0 for keys outside the zones.
+ */
+#define KZ(zone) ((zone) + 1)
+
+static const u8 key_zone[] = {
+	[KEY_ESC] = KZ(2), [KEY_F1] = KZ(2), [KEY_F2] = KZ(2), [KEY_F3] = KZ(2),
+	[KEY_F4] = KZ(2), [KEY_GRAVE] = KZ(2), [KEY_1] = KZ(2), [KEY_2] = KZ(2),
+	[KEY_3] = KZ(2), [KEY_4] = KZ(2), [KEY_5] = KZ(2), [KEY_TAB] = KZ(2),
+	[KEY_Q] = KZ(2), [KEY_E] = KZ(2), [KEY_R] = KZ(2), [KEY_T] = KZ(2),
+	[KEY_CAPSLOCK] = KZ(2), [KEY_F] = KZ(2), [KEY_G] = KZ(2),
+	[KEY_LEFTSHIFT] = KZ(2), [KEY_102ND] = KZ(2), [KEY_Z] = KZ(2),
+	[KEY_X] = KZ(2), [KEY_C] = KZ(2), [KEY_V] = KZ(2), [KEY_LEFTCTRL] = KZ(2),
+	[KEY_LEFTMETA] = KZ(2), [KEY_LEFTALT] = KZ(2), [KEY_FN] = KZ(2),
+
+	[KEY_W] = KZ(3), [KEY_A] = KZ(3), [KEY_S] = KZ(3), [KEY_D] = KZ(3),
+
+	[KEY_F5] = KZ(1), [KEY_F6] = KZ(1), [KEY_F7] = KZ(1), [KEY_F8] = KZ(1),
+	[KEY_6] = KZ(1), [KEY_7] = KZ(1), [KEY_8] = KZ(1), [KEY_9] = KZ(1),
+	[KEY_0] = KZ(1), [KEY_Y] = KZ(1), [KEY_U] = KZ(1), [KEY_I] = KZ(1),
+	[KEY_O] = KZ(1), [KEY_P] = KZ(1), [KEY_H] = KZ(1), [KEY_J] = KZ(1),
+	[KEY_K] = KZ(1), [KEY_L] = KZ(1), [KEY_B] = KZ(1), [KEY_N] = KZ(1),
+	[KEY_M] = KZ(1), [KEY_SPACE] = KZ(1),
+
+	[KEY_F9] = KZ(0), [KEY_F10] = KZ(0), [KEY_F11] = KZ(0), [KEY_F12] = KZ(0),
+	[KEY_MINUS] = KZ(0), [KEY_EQUAL] = KZ(0), [KEY_BACKSPACE] = KZ(0),
+	[KEY_LEFTBRACE] = KZ(0), [KEY_RIGHTBRACE] = KZ(0), [KEY_BACKSLASH] = KZ(0),
+	[KEY_SEMICOLON] = KZ(0), [KEY_APOSTROPHE] = KZ(0), [KEY_ENTER] = KZ(0),
+	[KEY_COMMA] = KZ(0), [KEY_DOT] = KZ(0), [KEY_SLASH] = KZ(0),
+	[KEY_RIGHTSHIFT] = KZ(0), [KEY_RIGHTALT] = KZ(0), [KEY_RIGHTCTRL] = KZ(0),
+	[KEY_COMPOSE] = KZ(0), [KEY_SYSRQ] = KZ(0), [KEY_INSERT] = KZ(0),
+	[KEY_DELETE] = KZ(0), [KEY_HOME] = KZ(0), [KEY_END] = KZ(0),
+	[KEY_PAGEUP] = KZ(0), [KEY_PAGEDOWN] = KZ(0), [KEY_UP] = KZ(0),
+	[KEY_DOWN] = KZ(0), [KEY_LEFT] = KZ(0), [KEY_RIGHT] = KZ(0),
+	[KEY_NUMLOCK] = KZ(0), [KEY_KPSLASH] = KZ(0), [KEY_KPASTERISK] = KZ(0),
+	[KEY_KPMINUS] = KZ(0), [KEY_KPPLUS] = KZ(0), [KEY_KPENTER] = KZ(0),
+	[KEY_KPDOT] = KZ(0), [KEY_KP0] = KZ(0), [KEY_KP1] = KZ(0), [KEY_KP2] = KZ(0),
+	[KEY_KP3] = KZ(0), [KEY_KP4] = KZ(0), [KEY_KP5] = KZ(0), [KEY_KP6] = KZ(0),
+	[KEY_KP7] = KZ(0), [KEY_KP8] = KZ(0), [KEY_KP9] = KZ(0),
+};
+
+/* Physical left-to-right position of each zone, used by the ripple */
+static const int zone_position[ZONE_COUNT] = { 3, 2, 0, 1 };
+
+static void react_reset(struct fourzone_priv *priv)
+{
+	/* Far enough in the past for every effect to have faded out */
+	unsigned long idle = jiffies - 10 * HZ;
+	unsigned long flags;
+
+	spin_lock_irqsave(&priv->react_lock, flags);
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		priv->react.zone_hit[zone] = idle;
+		priv->react.heat[zone] = 0;
+		priv->react.heat_stamp[zone] = idle;
+	}
+	priv->react.ripple_start = idle;
+	priv->react.ripple_origin = 0;
+	priv->react.pending = 0;
+	spin_unlock_irqrestore(&priv->react_lock, flags);
+}
+
+/* Heat decays linearly, faster with higher animation speed */
+static int react_heat(const struct fourzone_react *react, int zone,
+							unsigned long now, int speed)
+{
+	unsigned int elapsed = jiffies_to_msecs(now - react->heat_stamp[zone]);
+	unsigned int decay = elapsed * speed / 10;
+
+	return decay >= react->heat[zone] ? 0 : react->heat[zone] - decay;
+}
+
+/* Zones light up on a keypress and fade out */
+static bool animation_reactive(struct fourzone_priv *priv, int speed,
+			const struct fourzone_react *react,
+			struct color_platform colors[ZONE_COUNT])
+{
+	unsigned int fade_ms = 3000 / speed;
+	bool busy = false;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		unsigned int since = jiffies_to_msecs(jiffies - react->zone_hit[zone]);
+		int intensity = since < fade_ms ? 100 - (since * 100) / fade_ms : 0;
+
+		colors[zone] = priv->frame.colors[zone];
+		scale_color(&colors[zone], intensity);
+		busy |= intensity > 0;
+	}
+	return busy;
+}
+
+/* A ring spreading from the zone of the last keypress */
+static bool animation_ripple(struct fourzone_priv *priv, int speed,
+			const struct fourzone_react *react,
+			struct color_platform colors[ZONE_COUNT])
+{
+	int step_ms = 600 / speed;
+	int elapsed = min(jiffies_to_msecs(jiffies - react->ripple_start), 10000u);
+	int origin = zone_position[react->ripple_origin];
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		int t = elapsed - abs(zone_position[zone] - origin) * step_ms;
+		int intensity = 0;
+
+		if (t >= 0 && t < 2 * step_ms)
+			intensity = 100 - (t * 100) / (2 * step_ms);
+
+		/* Keep the keyboard dimly lit between ripples */
+		colors[zone] = priv->frame.colors[zone];
+		scale_color(&colors[zone], max(intensity, 12));
+	}
+	return elapsed < (ZONE_COUNT + 1) * step_ms;
+}
+
+/* Typing activity per zone, from cold blue to hot red */
+static bool animation_heatmap(struct fourzone_priv *priv, int speed,
+			const struct fourzone_react *react,
+			struct color_platform colors[ZONE_COUNT])
+{
+	unsigned long now = jiffies;
+	bool busy = false;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		int heat = react_heat(react, zone, now, speed);
+
+		oklab_gradient(heat_stops, ARRAY_SIZE(heat_stops),
+					 (heat * 4096) / REACT_HEAT_MAX, &colors[zone]);
+		scale_color(&colors[zone], 20 + (heat * 80) / REACT_HEAT_MAX);
+		busy |= heat > 0;
+	}
+	return busy;
+}
+
+static void record_key_latency(struct fourzone_priv *priv, ktime_t pressed)
+{
+	struct fourzone_latency *lat = &priv->latency;
+	u64 us = ktime_us_delta(ktime_get(), pressed);
+
+	lat->count++;
+	lat->total_us += us;
+	lat->last_us = us;
+	lat->max_us = max(lat->max_us, us);
+}
+
+
+/*
+ * Streamed frames. The producer never waits for the driver: each frame the
+ * worker takes the newest complete slot and everything published before it
+ * counts as dropped. A slot that changes while being copied is retried with
+ * the next frame.
+ */
+static void stream_take(struct fourzone_priv *priv)
+{
+	struct omen_rgb_ring *ring = priv->ring;
+	struct omen_rgb_color colors[ZONE_COUNT];
+	const struct omen_rgb_slot *slot;
+	u32 produced, seq;
+
+	produced = smp_load_acquire(&ring->produced);
+	if (produced == priv->stream_consumed)
+		return;
+
+	slot = &ring->slot[READ_ONCE(ring->head) % OMEN_RGB_RING_SLOTS];
+	seq = smp_load_acquire(&slot->seq);
+	memcpy(colors, slot->colors, sizeof(colors));
+	smp_rmb();
+	if ((seq & 1) || READ_ONCE(slot->seq) != seq) {
+		priv->stream_torn++;
+		return;
+	}
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		priv->stream_frame[zone].red = colors[zone].red;
+		priv->stream_frame[zone].green = colors[zone].green;
+		priv->stream_frame[zone].blue = colors[zone].blue;
+	}
+	priv->stream_valid = true;
+	priv->stream_dropped += produced - priv->stream_consumed - 1;
+	priv->stream_consumed = produced;
+	priv->stream_shown++;
+
+	WRITE_ONCE(ring->shown, priv->stream_shown);
+	WRITE_ONCE(ring->dropped, priv->stream_dropped);
+}
+
+/* Base colors until the first frame arrives, the newest frame after that */
+static void animation_stream(struct fourzone_priv *priv,
+			     struct color_platform colors[ZONE_COUNT])
+{
+	if (priv->ring)
+		stream_take(priv);
+
+	memcpy(colors, priv->stream_valid ? priv->stream_frame : priv->frame.colors,
+	       sizeof(priv->stream_frame));
 }
 
 /* State persistence functions */
-static void save_animation_state(void)
+static void save_work_func(struct work_struct *work)
 {
+	struct fourzone_priv *priv = container_of(to_delayed_work(work),
+						  struct fourzone_priv, save_work);
+	struct fourzone_config cfg;
 	struct file *fp;
 	struct animation_state state;
 	loff_t pos = 0;
 	
 	/* Prepare state data */
-	state.mode = current_animation;
-	state.speed = animation_speed;
-	state.brightness = global_brightness;
+	fourzone_config_get(priv, &cfg);
+	memset(&state, 0, sizeof(state));
+	state.magic = STATE_MAGIC;
+	state.version = STATE_VERSION;
+	state.base.mode = cfg.mode;
+	state.base.speed = cfg.speed;
+	state.base.brightness = cfg.brightness;
 	
 	/* Copy current colors */
 	for (int i = 0; i < ZONE_COUNT; i++) {
-		state.colors[i] = original_colors[i].colors;
+		state.base.colors[i] = cfg.colors[i];
 	}
+	memcpy(state.gamma, cfg.gamma, sizeof(state.gamma));
+	memcpy(state.calib, cfg.calib, sizeof(state.calib));
+	memcpy(state.zone_mode, cfg.zone_mode, sizeof(state.zone_mode));
+	memcpy(state.zone_speed, cfg.zone_speed, sizeof(state.zone_speed));
 	
 	{
 		struct dentry *dentry;
@@ -707,341 +2053,2366 @@ static void save_animation_state(void)
 	pr_info("Animation state saved\n");
 }
 
-static void load_animation_state(void)
+/*
+ * Saving is deferred so a burst of changes results in a single write. The
+ * pending save is flushed on suspend and when the device goes away.
+ */
+static void save_animation_state(struct fourzone_priv *priv)
 {
-	struct file *fp;
-	struct animation_state state;
-	loff_t pos = 0;
-	ssize_t ret;
-	
-	/* Open file for reading */
-	fp = filp_open(STATE_FILE_PATH, O_RDONLY, 0);
-	if (IS_ERR(fp)) {
-		pr_info("No saved animation state found\n");
-		return;
-	}
-	
-	/* Read state from file */
-	ret = kernel_read(fp, &state, sizeof(state), &pos);
-	if (ret != sizeof(state)) {
-		pr_warn("Failed to read animation state\n");
-		filp_close(fp, NULL);
-		return;
-	}
-	
-	filp_close(fp, NULL);
+	mod_delayed_work(system_wq, &priv->save_work, msecs_to_jiffies(STATE_SAVE_DELAY_MS));
+}
+
+/* Apply the explicitly set module parameters on top of a configuration */
+static bool apply_module_params(struct fourzone_config *cfg)
+{
+	bool changed = false;
+
+	if (initial_mode && *initial_mode) {
+		int mode = parse_animation_mode(initial_mode);
+
+		if (mode < 0) {
+			pr_warn("Ignoring unknown mode parameter '%s'\n", initial_mode);
+		} else {
+			cfg->mode = mode;
+			changed = true;
+		}
+	}
+	if (initial_speed >= ANIMATION_SPEED_MIN && initial_speed <= ANIMATION_SPEED_MAX) {
+		cfg->speed = initial_speed;
+		changed = true;
+	}
+	if (initial_brightness >= 0) {
+		cfg->brightness = min(initial_brightness, 100);
+		changed = true;
+	}
+	for (int i = 0; i < initial_colors_count; i++) {
+		if (initial_colors[i] > 0xFFFFFF) {
+			pr_warn("Ignoring invalid color 0x%x for zone %d\n", initial_colors[i], i);
+			continue;
+		}
+		rgb_to_color(initial_colors[i], &cfg->colors[i]);
+		changed = true;
+	}
+
+	return changed;
+}
+
+/* Write the current state to the hardware and (re)start the animation */
+static void apply_initial_state(struct fourzone_priv *priv)
+{
+	fourzone_led_sync(priv);
+	stop_animation(priv);
+	start_animation(priv);
+}
+
+/*
+ * Parse a saved state. Files written before the versioned header are
+ * plain struct animation_state_v0 and leave gamma and calibration at their
+ * defaults, version 1 files leave every zone following the global mode.
+ */
+static int parse_animation_state(const u8 *data, size_t size,
+				 struct animation_state *state)
+{
+	memset(state, 0, sizeof(*state));
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		memcpy(state->calib[zone], calib_identity, sizeof(calib_identity));
+		state->zone_mode[zone] = ZONE_MODE_GLOBAL;
+	}
+
+	if (size == sizeof(state->base)) {
+		memcpy(&state->base, data, size);
+		return 0;
+	}
+	if (size != STATE_V1_SIZE && size != sizeof(*state))
+		return -EINVAL;
+
+	memcpy(state, data, size);
+	if (state->magic != STATE_MAGIC)
+		return -EINVAL;
+	if (state->version != (size == STATE_V1_SIZE ? 1 : STATE_VERSION))
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Firmware loader callback for the saved profile. The blob has the same
+ * layout as STATE_FILE_PATH, so the saved state can be exposed to the
+ * firmware search path without any VFS access here.
+ */
+static void load_animation_state(const struct firmware *fw, void *context)
+{
+	struct fourzone_priv *priv = context;
+	struct animation_state state;
+	struct fourzone_config *cfg = &priv->config;
+	unsigned long flags;
+	
+	if (!fw) {
+		pr_info("No saved animation state found\n");
+		return;
+	}
+	
+	if (parse_animation_state(fw->data, fw->size, &state)) {
+		pr_warn("Ignoring saved animation state of unknown format, size %zu\n", fw->size);
+		goto out;
+	}
+	
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	if (priv->state_user_set) {
+		write_sequnlock_irqrestore(&priv->config_lock, flags);
+		pr_info("Ignoring saved animation state, settings changed since load\n");
+		goto out;
+	}
+	if (state.base.mode >= 0 && state.base.mode < ANIMATION_COUNT) {
+		cfg->mode = state.base.mode;
+	}
+	if (state.base.speed >= ANIMATION_SPEED_MIN && state.base.speed <= ANIMATION_SPEED_MAX) {
+		cfg->speed = state.base.speed;
+	}
+	if (state.base.brightness >= 0 && state.base.brightness <= 100) {
+		cfg->brightness = state.base.brightness;
+	}
 	
-	if (state.mode >= 0 && state.mode < ANIMATION_COUNT) {
-		current_animation = state.mode;
+	/* Restore colors */
+	for (int i = 0; i < ZONE_COUNT; i++) {
+		cfg->colors[i] = state.base.colors[i];
+	}
+	for (int i = 0; i < ARRAY_SIZE(state.gamma); i++) {
+		if (state.gamma[i] < GAMMA_COUNT)
+			cfg->gamma[i] = state.gamma[i];
+	}
+	for (int i = 0; i < ZONE_COUNT; i++) {
+		if (calib_valid(state.calib[i]))
+			memcpy(cfg->calib[i], state.calib[i], sizeof(cfg->calib[i]));
+	}
+	calib_update_mask(cfg);
+	for (int i = 0; i < ZONE_COUNT; i++) {
+		if (state.zone_mode[i] < ANIMATION_COUNT || state.zone_mode[i] == ZONE_MODE_GLOBAL)
+			cfg->zone_mode[i] = state.zone_mode[i];
+		if (!state.zone_speed[i] || (state.zone_speed[i] >= ANIMATION_SPEED_MIN &&
+					     state.zone_speed[i] <= ANIMATION_SPEED_MAX))
+			cfg->zone_speed[i] = state.zone_speed[i];
+	}
+	
+	/* Module parameters win over the saved profile */
+	apply_module_params(cfg);
+	write_sequnlock_irqrestore(&priv->config_lock, flags);
+	fourzone_config_changed(priv);
+	apply_initial_state(priv);
+	
+	pr_info("Animation state loaded: mode=%d, speed=%d, brightness=%d\n", 
+		cfg->mode, cfg->speed, cfg->brightness);
+out:
+	release_firmware(fw);
+}
+
+/*
+ * Idle dimming. Keypresses only stamp last_input; idle_work checks once per
+ * timeout whether the keyboard went idle and starts the fade, which the
+ * frame worker renders. Once faded out the frame timer is stopped entirely,
+ * the next keypress brings the lighting back.
+ */
+static bool animation_is_continuous(struct fourzone_priv *priv)
+{
+	return priv->animation_active &&
+				 (fourzone_active_modes(priv) & CONTINUOUS_MODES) &&
+				 !READ_ONCE(priv->parked);
+}
+
+static void idle_work_func(struct work_struct *work)
+{
+	struct fourzone_priv *priv = container_of(to_delayed_work(work),
+						  struct fourzone_priv, idle_work);
+	unsigned long timeout = secs_to_jiffies(READ_ONCE(priv->idle_timeout));
+	unsigned long idle_for = jiffies - READ_ONCE(priv->last_input);
+	unsigned long flags;
+
+	if (!timeout)
+		return;
+	if (idle_for < timeout) {
+		schedule_delayed_work(&priv->idle_work, timeout - idle_for);
+		return;
+	}
+
+	spin_lock_irqsave(&priv->react_lock, flags);
+	if (priv->idle_state == IDLE_ACTIVE) {
+		priv->idle_state = IDLE_FADING;
+		priv->idle_fade_start = jiffies;
+	}
+	spin_unlock_irqrestore(&priv->react_lock, flags);
+
+	schedule_work(&priv->animation_work);
+}
+
+/* Input activity, called from atomic context for every keypress */
+static void idle_input(struct fourzone_priv *priv)
+{
+	unsigned long flags;
+	bool woke = false;
+
+	WRITE_ONCE(priv->last_input, jiffies);
+	if (READ_ONCE(priv->idle_state) == IDLE_ACTIVE)
+		return;
+
+	spin_lock_irqsave(&priv->react_lock, flags);
+	if (priv->idle_state != IDLE_ACTIVE) {
+		priv->idle_state = IDLE_ACTIVE;
+		woke = true;
+	}
+	spin_unlock_irqrestore(&priv->react_lock, flags);
+
+	if (!woke)
+		return;
+
+	schedule_work(&priv->animation_work);
+	if (animation_is_continuous(priv))
+		animation_arm_timer(priv);
+	if (READ_ONCE(priv->idle_timeout))
+		schedule_delayed_work(&priv->idle_work,
+				      secs_to_jiffies(READ_ONCE(priv->idle_timeout)));
+}
+
+/* Output level for the next frame, finishes the fade once it runs out */
+static int idle_level(struct fourzone_priv *priv)
+{
+	unsigned long flags;
+	unsigned int elapsed;
+	int level = 100;
+
+	spin_lock_irqsave(&priv->react_lock, flags);
+	switch (priv->idle_state) {
+	case IDLE_ACTIVE:
+		break;
+	case IDLE_FADING:
+		elapsed = jiffies_to_msecs(jiffies - priv->idle_fade_start);
+		if (elapsed < priv->idle_fade) {
+			level = 100 - (elapsed * 100) / priv->idle_fade;
+			break;
+		}
+		priv->idle_state = IDLE_DIMMED;
+		fallthrough;
+	case IDLE_DIMMED:
+		level = 0;
+		break;
+	}
+	spin_unlock_irqrestore(&priv->react_lock, flags);
+
+	return level;
+}
+
+/* (Re)start idle tracking after the timeout changed */
+static void idle_restart(struct fourzone_priv *priv)
+{
+	cancel_delayed_work_sync(&priv->idle_work);
+	priv->last_input = jiffies;
+	idle_input(priv);
+	if (priv->idle_timeout)
+		schedule_delayed_work(&priv->idle_work, secs_to_jiffies(priv->idle_timeout));
+}
+
+/*
+ * One mode at one speed for the zones in the group, true while a reactive
+ * effect fades. Zones outside the group may be left unset.
+ */
+static bool animation_render_mode(struct fourzone_priv *priv, enum animation_mode mode,
+				  int speed, u8 zones, const struct fourzone_react *react,
+				  struct color_platform colors[ZONE_COUNT])
+{
+	switch (mode) {
+	case ANIMATION_BREATHING:
+		animation_breathing(priv, speed, colors);
+		break;
+	case ANIMATION_RAINBOW:
+		animation_rainbow(priv, speed, colors);
+		break;
+	case ANIMATION_WAVE:
+		animation_wave(priv, speed, colors);
+		break;
+	case ANIMATION_PULSE:
+		animation_pulse(priv, speed, colors);
+		break;
+	case ANIMATION_CHASE:
+		animation_chase(priv, speed, colors);
+		break;
+	case ANIMATION_SPARKLE:
+		animation_sparkle(priv, speed, zones, colors);
+		break;
+	case ANIMATION_CANDLE:
+		animation_candle(priv, speed, colors);
+		break;
+	case ANIMATION_AURORA:
+		animation_aurora(priv, speed, colors);
+		break;
+	case ANIMATION_DISCO:
+		animation_disco(priv, speed, colors);
+		break;
+	case ANIMATION_REACTIVE:
+		return animation_reactive(priv, speed, react, colors);
+	case ANIMATION_RIPPLE:
+		return animation_ripple(priv, speed, react, colors);
+	case ANIMATION_HEATMAP:
+		return animation_heatmap(priv, speed, react, colors);
+	case ANIMATION_STREAM:
+		animation_stream(priv, colors);
+		break;
+	default:
+		memcpy(colors, priv->frame.colors, sizeof(priv->frame.colors));
+		break;
+	}
+	return false;
+}
+
+/*
+ * Every zone runs its own mode and speed. Zones that share both are rendered
+ * together, so effects spanning zones (wave, chase, ripple) stay in step,
+ * and the result is committed as one frame.
+ *
+ * Reactive effects are event driven: a keypress queues a frame right away
+ * and the timer only keeps running while something is still fading.
+ */
+static void animation_render_frame(struct fourzone_priv *priv)
+{
+	u32 modes = fourzone_modes(&priv->frame);
+	struct color_platform colors[ZONE_COUNT], tmp[ZONE_COUNT];
+	struct fourzone_react react = { };
+	unsigned long now = jiffies;
+	unsigned long flags;
+	bool busy = false;
+	u8 done = 0;
+
+	/* Static frames are only rendered on request, e.g. by an LED trigger */
+	if (modes == BIT(ANIMATION_STATIC) || !priv->animation_active) {
+		show_original_colors(priv);
+		return;
+	}
+
+	if (modes & REACTIVE_MODES) {
+		spin_lock_irqsave(&priv->react_lock, flags);
+		react = priv->react;
+		priv->react.pending = 0;
+		spin_unlock_irqrestore(&priv->react_lock, flags);
+	}
+
+	priv->render_dt = now - priv->render_last;
+	priv->render_last = now;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		enum animation_mode mode = zone_mode(&priv->frame, zone);
+		int speed = zone_speed(&priv->frame, zone);
+		u8 group = 0;
+
+		if (done & BIT(zone))
+			continue;
+
+		for (int other = zone; other < ZONE_COUNT; other++) {
+			if (zone_mode(&priv->frame, other) == mode &&
+			    zone_speed(&priv->frame, other) == speed)
+				group |= BIT(other);
+		}
+
+		busy |= animation_render_mode(priv, mode, speed, group, &react, tmp);
+		for (int other = zone; other < ZONE_COUNT; other++) {
+			if (group & BIT(other))
+				colors[other] = tmp[other];
+		}
+		done |= group;
+	}
+
+	update_all_zones_with_colors(priv, colors);
+
+	if (react.pending)
+		record_key_latency(priv, react.pending);
+
+	if (busy && priv->animation_active)
+		animation_arm_timer(priv);
+}
+
+/*
+ * Parking. While nothing visible can change (brightness 0, idle dimmed,
+ * lighting off by policy or backlight off by the hotkey) the frame timers are
+ * stopped and only an explicit kick runs the worker again.
+ */
+static bool fourzone_output_dark(struct fourzone_priv *priv)
+{
+	return priv->frame.brightness == 0 || priv->frame.level == 0 ||
+				 READ_ONCE(priv->brightness_cap) == 0 ||
+				 priv->output_level == 0 || READ_ONCE(priv->backlight_off);
+}
+
+static void animation_park(struct fourzone_priv *priv)
+{
+	animation_delete_timers(priv, false);
+	if (priv->parked)
+		return;
+
+	priv->parked_since = jiffies;
+	WRITE_ONCE(priv->parked, true);
+}
+
+static void animation_unpark(struct fourzone_priv *priv)
+{
+	if (!priv->parked)
+		return;
+
+	priv->parked_ms += jiffies_to_msecs(jiffies - priv->parked_since);
+	WRITE_ONCE(priv->parked, false);
+	if (animation_is_continuous(priv))
+		animation_arm_timer(priv);
+}
+
+/* Queue a frame after something relevant changed, unparks if needed */
+static void animation_kick(struct fourzone_priv *priv)
+{
+	if (!priv->animation_active || READ_ONCE(priv->parked))
+		schedule_work(&priv->animation_work);
+}
+
+/*
+ * Slow effects look the same whether a frame lands a few ms early or late,
+ * so in low power mode they run off a deferrable timer. It does not wake an
+ * idle CPU and fires with the next wakeup that happens anyway.
+ */
+static bool animation_is_slow(u32 modes)
+{
+	return !(modes & ~(SLOW_MODES | BIT(ANIMATION_STATIC)));
+}
+
+/*
+ * Transitions. When the mode or the base colors change, the worker blends
+ * from the frame that was on screen to the output of the new target over
+ * transition_ms, so switching effects or colors never snaps. A change in the
+ * middle of a transition starts over from the blended frame.
+ */
+#define TRANSITION_MAX_MS 10000
+
+static void animation_transition_update(struct fourzone_priv *priv)
+{
+	unsigned int ms = READ_ONCE(priv->transition_ms);
+	bool changed = false;
+	unsigned long elapsed;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		u8 mode = zone_mode(&priv->frame, zone);
+
+		changed |= mode != priv->transition_modes[zone];
+		priv->transition_modes[zone] = mode;
+	}
+
+	if (changed ||
+	    memcmp(priv->frame.colors, priv->transition_colors, sizeof(priv->transition_colors))) {
+		memcpy(priv->transition_colors, priv->frame.colors, sizeof(priv->transition_colors));
+
+		if (ms && priv->rendered_valid) {
+			for (int zone = 0; zone < ZONE_COUNT; zone++)
+				rgb16_to_oklab(&priv->rendered[zone], &priv->transition_from[zone]);
+			priv->transition_start = jiffies;
+			priv->transition_len = max(msecs_to_jiffies(ms), 1UL);
+			priv->transition_active = true;
+		}
+	}
+
+	if (!priv->transition_active)
+		return;
+
+	elapsed = jiffies - priv->transition_start;
+	if (elapsed >= priv->transition_len) {
+		priv->transition_active = false;
+		return;
+	}
+	priv->transition_pos = elapsed * 256 / priv->transition_len;
+}
+
+/* Frame rate the timer runs at, after the battery policy cap */
+static unsigned int animation_fps(struct fourzone_priv *priv)
+{
+	unsigned int fps = READ_ONCE(priv->frame_rate);
+	unsigned int cap = READ_ONCE(priv->fps_cap);
+
+	return cap && cap < fps ? cap : fps;
+}
+
+/*
+ * Dithering averages over consecutive frames. It only goes unnoticed when
+ * they come steadily and fast enough, not on the deferrable low power timer
+ * and not for static colors that are drawn once.
+ */
+#define DITHER_MAX_INTERVAL_MS 25
+
+static bool animation_can_dither(struct fourzone_priv *priv)
+{
+	if (!READ_ONCE(priv->dither) || 1000 / animation_fps(priv) > DITHER_MAX_INTERVAL_MS)
+		return false;
+	if (READ_ONCE(priv->low_power) && animation_is_slow(fourzone_modes(&priv->frame)))
+		return false;
+	return animation_is_continuous(priv) || priv->idle_state == IDLE_FADING ||
+	       priv->transition_active;
+}
+
+static void animation_frame(struct fourzone_priv *priv)
+{
+	fourzone_config_get(priv, &priv->frame);
+	if (READ_ONCE(priv->rng_reseed)) {
+		WRITE_ONCE(priv->rng_reseed, false);
+		animation_reseed(priv);
+	}
+	fourzone_palette_refresh(priv);
+	animation_transition_update(priv);
+	priv->output_level = idle_level(priv);
+	priv->dither_active = animation_can_dither(priv);
+
+	/* Colors written while the backlight is off are redrawn when it comes back */
+	if (!READ_ONCE(priv->backlight_off))
+		animation_render_frame(priv);
+
+	if (fourzone_output_dark(priv)) {
+		animation_park(priv);
+		return;
+	}
+
+	animation_unpark(priv);
+	/* Fades and transitions need frames even for static colors */
+	if (priv->idle_state == IDLE_FADING || priv->transition_active)
+		animation_arm_timer(priv);
+}
+
+/* Animation work function - runs in work queue context */
+static void animation_work_func(struct work_struct *work)
+{
+	struct fourzone_priv *priv = container_of(work, struct fourzone_priv, animation_work);
+
+	/* LED triggers and keypresses can still queue frames while suspending */
+	if (READ_ONCE(priv->suspended))
+		return;
+
+	animation_frame(priv);
+}
+
+static void animation_delete_timers(struct fourzone_priv *priv, bool sync)
+{
+	if (sync) {
+		timer_delete_sync(&priv->animation_timer);
+		timer_delete_sync(&priv->animation_timer_lp);
+	} else {
+		timer_delete(&priv->animation_timer);
+		timer_delete(&priv->animation_timer_lp);
+	}
+}
+
+static void animation_arm_timer(struct fourzone_priv *priv)
+{
+	bool deferrable = READ_ONCE(priv->low_power) &&
+			  animation_is_slow(fourzone_active_modes(priv));
+	unsigned long expires;
+
+	if (READ_ONCE(priv->suspended))
+		return;
+	expires = jiffies + msecs_to_jiffies(1000 / animation_fps(priv));
+
+	if (deferrable) {
+		timer_delete(&priv->animation_timer);
+		mod_timer(&priv->animation_timer_lp, expires);
+	} else {
+		timer_delete(&priv->animation_timer_lp);
+		mod_timer(&priv->animation_timer, expires);
+	}
+}
+
+static void animation_count_wakeup(struct fourzone_priv *priv, bool deferred)
+{
+	unsigned long now = jiffies;
+
+	if (deferred) {
+		priv->timer_fires_deferred++;
+		return;
+	}
+
+	priv->timer_fires++;
+	if (time_after_eq(now, priv->wakeup_window + HZ)) {
+		priv->wakeup_rate = priv->wakeup_window_count * HZ / (now - priv->wakeup_window);
+		priv->wakeup_window = now;
+		priv->wakeup_window_count = 0;
+	}
+	priv->wakeup_window_count++;
+}
+
+static void animation_timer_fired(struct fourzone_priv *priv, bool deferred)
+{
+	animation_count_wakeup(priv, deferred);
+
+	queue_work(deferred ? system_power_efficient_wq : system_wq, &priv->animation_work);
+	/* Reactive effects and fades re-arm from the worker while needed */
+	if (animation_is_continuous(priv))
+		animation_arm_timer(priv);
+}
+
+/* Animation timer callback */
+static void animation_timer_callback(struct timer_list *t)
+{
+	struct fourzone_priv *priv = timer_container_of(priv, t, animation_timer);
+
+	animation_timer_fired(priv, false);
+}
+
+static void animation_timer_lp_callback(struct timer_list *t)
+{
+	struct fourzone_priv *priv = timer_container_of(priv, t, animation_timer_lp);
+
+	animation_timer_fired(priv, true);
+}
+
+static void start_animation(struct fourzone_priv *priv)
+{
+	u32 modes = fourzone_active_modes(priv);
+
+	/* The on-battery policy may hold animations back, see power_policy_apply() */
+	if (modes == BIT(ANIMATION_STATIC) || priv->policy_hold) {
+		priv->animation_active = false;
+		return;
+	}
+	
+	if (modes & REACTIVE_MODES)
+		react_reset(priv);
+	
+	WRITE_ONCE(priv->rng_reseed, true);
+	WRITE_ONCE(priv->animation_start_time, jiffies);
+	WRITE_ONCE(priv->animation_active, true);
+	
+	/* Start the timer */
+	animation_arm_timer(priv);
+}
+
+/* Rendering is left to the frame worker, writers never wait for the firmware */
+static void stop_animation(struct fourzone_priv *priv)
+{
+	WRITE_ONCE(priv->animation_active, false);
+	animation_delete_timers(priv, false);
+	
+	/* Restore original colors */
+	schedule_work(&priv->animation_work);
+}
+
+/*
+ * Follow a change of a mode or speed, called after the change is published.
+ * Zones that keep running are not restarted, their effects continue in phase.
+ * No frame is queued with the animation stopped unless the target is static,
+ * so a transition always starts from the frame that was on screen.
+ */
+static void animation_modes_changed(struct fourzone_priv *priv)
+{
+	u32 modes = fourzone_active_modes(priv);
+
+	if (modes == BIT(ANIMATION_STATIC)) {
+		stop_animation(priv);
+		return;
+	}
+
+	if (!priv->animation_active)
+		start_animation(priv);
+	else if (modes & CONTINUOUS_MODES)
+		animation_arm_timer(priv);
+	schedule_work(&priv->animation_work);
+}
+
+static ssize_t all_show(struct device *dev, struct device_attribute *attr,
+												char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct fourzone_config cfg;
+
+	fourzone_config_get(priv, &cfg);
+	return sprintf(buf, "#%02x%02x%02x\n",
+							 cfg.colors[0].red, cfg.colors[0].green, cfg.colors[0].blue);
+}
+
+static ssize_t fourzone_show_colors(char *buf, const struct color_platform colors[ZONE_COUNT])
+{
+	ssize_t len = 0;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		len += sprintf(buf + len, "%s#%02x%02x%02x", zone ? " " : "",
+			       colors[zone].red, colors[zone].green, colors[zone].blue);
+
+	return len + sprintf(buf + len, "\n");
+}
+
+/* Colors of the last frame committed, after brightness and effects */
+static ssize_t displayed_show(struct device *dev, struct device_attribute *attr,
+			      char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct color_platform colors[ZONE_COUNT];
+	struct fourzone_config cfg;
+
+	fourzone_snapshot(priv, &cfg, colors);
+	return fourzone_show_colors(buf, colors);
+}
+
+/* Asks the firmware, for when something else may have changed the colors */
+static ssize_t hw_readback_show(struct device *dev, struct device_attribute *attr,
+				char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct color_platform colors[ZONE_COUNT];
+	u8 state[FOURZONE_STATE_SIZE];
+	int ret;
+
+	hp_wmi_begin();
+	ret = hp_wmi_perform_query(HPWMI_FOURZONE_COLOR_GET, HPWMI_FOURZONE,
+				   state, sizeof(state), sizeof(state));
+	hp_wmi_end();
+	if (ret)
+		return ret < 0 ? ret : -EIO;
+
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		u8 *color = &state[priv->zone_data[zone].offset];
+
+		colors[zone].red = color[0];
+		colors[zone].green = color[1];
+		colors[zone].blue = color[2];
+	}
+
+	return fourzone_show_colors(buf, colors);
+}
+
+static DEVICE_ATTR_RO(displayed);
+static DEVICE_ATTR_ADMIN_RO(hw_readback);
+
+static ssize_t all_set(struct device *dev, struct device_attribute *attr,
+											 const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct platform_zone temp;
+	unsigned long flags;
+	int ret;
+	u8 z;
+
+	ret = parse_rgb(buf, &temp);
+	if (ret)
+		return ret;
+
+	/* Store the new color as the original color */
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	for (z = 0; z < ZONE_COUNT; z++)
+		priv->config.colors[z] = temp.colors;
+	priv->config.mode = ANIMATION_STATIC;
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+	fourzone_led_sync(priv);
+
+	/* Zones with their own mode keep running */
+	animation_modes_changed(priv);
+
+	/* Save state */
+	save_animation_state(priv);
+
+	return count;
+}
+
+static ssize_t frame_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct fourzone_config cfg;
+	ssize_t len = 0;
+
+	fourzone_config_get(priv, &cfg);
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		len += sprintf(buf + len, "%s%02x%02x%02x", zone ? " " : "",
+			       cfg.colors[zone].red, cfg.colors[zone].green, cfg.colors[zone].blue);
+
+	return len + sprintf(buf + len, "\n");
+}
+
+/* All zone colors in one write, shown as one frame and saved once */
+static ssize_t frame_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct color_platform colors[ZONE_COUNT];
+	unsigned long flags;
+	int ret;
+
+	ret = parse_frame(buf, count, colors);
+	if (ret)
+		return ret;
+
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	memcpy(priv->config.colors, colors, sizeof(colors));
+	priv->config.mode = ANIMATION_STATIC;
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+	fourzone_led_sync(priv);
+
+	animation_modes_changed(priv);
+	save_animation_state(priv);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(frame);
+
+/* One curve for all channels, or one per channel in red green blue order */
+static ssize_t gamma_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct fourzone_config cfg;
+
+	fourzone_config_get(priv, &cfg);
+	return sprintf(buf, "%s %s %s\n", gamma_names[cfg.gamma[0]],
+		       gamma_names[cfg.gamma[1]], gamma_names[cfg.gamma[2]]);
+}
+
+static ssize_t gamma_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	char text[32], *cur = text, *tok;
+	u8 gamma[3];
+	unsigned long flags;
+	int n = 0;
+
+	if (count >= sizeof(text))
+		return -EINVAL;
+	memcpy(text, buf, count);
+	text[count] = '\0';
+
+	while ((tok = strsep(&cur, " \n"))) {
+		int curve;
+
+		if (!*tok)
+			continue;
+		if (n == ARRAY_SIZE(gamma))
+			return -EINVAL;
+		curve = match_string(gamma_names, GAMMA_COUNT, tok);
+		if (curve < 0)
+			return curve;
+		gamma[n++] = curve;
+	}
+
+	if (n == 1)
+		gamma[1] = gamma[2] = gamma[0];
+	else if (n != ARRAY_SIZE(gamma))
+		return -EINVAL;
+
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	memcpy(priv->config.gamma, gamma, sizeof(gamma));
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+	animation_kick(priv);
+	save_animation_state(priv);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(gamma);
+
+/*
+ * One line per zone with its calibration matrix in Q10 (1024 is 1.0), row by
+ * row. Written as "<zone> <r> <g> <b>" for per-channel gains or
+ * "<zone>" followed by all nine entries, "reset" restores identity.
+ */
+static ssize_t calibration_show(struct device *dev, struct device_attribute *attr,
+				char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct fourzone_config cfg;
+	ssize_t len = 0;
+
+	fourzone_config_get(priv, &cfg);
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		len += sprintf(buf + len, "%d:", zone);
+		for (int i = 0; i < 9; i++)
+			len += sprintf(buf + len, " %d", cfg.calib[zone][i]);
+		len += sprintf(buf + len, "\n");
+	}
+	return len;
+}
+
+static ssize_t calibration_store(struct device *dev, struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	char text[96], *cur = text, *tok;
+	int val[10];
+	s16 m[9];
+	unsigned long flags;
+	int n = 0;
+
+	if (sysfs_streq(buf, "reset")) {
+		write_seqlock_irqsave(&priv->config_lock, flags);
+		for (int zone = 0; zone < ZONE_COUNT; zone++)
+			memcpy(priv->config.calib[zone], calib_identity, sizeof(calib_identity));
+		calib_update_mask(&priv->config);
+		fourzone_config_user_unlock(priv, flags);
+		goto out;
+	}
+
+	if (count >= sizeof(text))
+		return -EINVAL;
+	memcpy(text, buf, count);
+	text[count] = '\0';
+
+	while ((tok = strsep(&cur, " \n"))) {
+		if (!*tok)
+			continue;
+		if (n == ARRAY_SIZE(val) || kstrtoint(tok, 10, &val[n]))
+			return -EINVAL;
+		if (n && (val[n] < -CALIB_MAX || val[n] > CALIB_MAX))
+			return -EINVAL;
+		n++;
+	}
+
+	if (n < 1 || val[0] < 0 || val[0] >= ZONE_COUNT)
+		return -EINVAL;
+	if (n == 4) {
+		memcpy(m, calib_identity, sizeof(m));
+		m[0] = val[1];
+		m[4] = val[2];
+		m[8] = val[3];
+	} else if (n == 10) {
+		for (int i = 0; i < 9; i++)
+			m[i] = val[i + 1];
+	} else {
+		return -EINVAL;
+	}
+
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	memcpy(priv->config.calib[val[0]], m, sizeof(m));
+	calib_update_mask(&priv->config);
+	fourzone_config_user_unlock(priv, flags);
+out:
+	fourzone_config_changed(priv);
+	animation_kick(priv);
+	save_animation_state(priv);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(calibration);
+
+/* Temporal dithering, only applied at frame rates that hide it */
+static ssize_t dither_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", priv->dither);
+}
+
+static ssize_t dither_store(struct device *dev, struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(priv->dither, enable);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(dither);
+
+static ssize_t transition_ms_show(struct device *dev, struct device_attribute *attr,
+				  char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", priv->transition_ms);
+}
+
+static ssize_t transition_ms_store(struct device *dev, struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned int ms;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &ms);
+	if (ret)
+		return ret;
+	if (ms > TRANSITION_MAX_MS)
+		return -EINVAL;
+
+	WRITE_ONCE(priv->transition_ms, ms);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(transition_ms);
+
+/* Seed of the random effects, 0 picks a new one each time an animation starts */
+static ssize_t seed_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", priv->seed);
+}
+
+static ssize_t seed_store(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	u32 seed;
+	int ret;
+
+	ret = kstrtou32(buf, 0, &seed);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(priv->seed, seed);
+	/* Restart from the new seed on the next frame */
+	WRITE_ONCE(priv->rng_reseed, true);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(seed);
+
+/* Animation control sysfs attributes */
+static ssize_t animation_mode_show(struct device *dev, struct device_attribute *attr,
+																	char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	enum animation_mode mode = READ_ONCE(priv->config.mode);
+
+	if (mode >= ANIMATION_COUNT)
+		return sprintf(buf, "unknown\n");
+	
+	return sprintf(buf, "%s\n", animation_mode_names[mode]);
+}
+
+static ssize_t animation_mode_set(struct device *dev, struct device_attribute *attr,
+																const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	int new_mode = parse_animation_mode(buf);
+	unsigned long flags;
+	
+	if (new_mode < 0)
+		return new_mode;
+	
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	priv->config.mode = new_mode;
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+	
+	animation_modes_changed(priv);
+	
+	/* Save state */
+	save_animation_state(priv);
+	
+	return count;
+}
+
+static ssize_t animation_speed_show(struct device *dev, struct device_attribute *attr,
+																	char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", READ_ONCE(priv->config.speed));
+}
+
+static ssize_t animation_speed_set(struct device *dev, struct device_attribute *attr,
+																const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned long speed;
+	unsigned long flags;
+	int ret;
+	
+	ret = kstrtoul(buf, 10, &speed);
+	if (ret)
+		return ret;
+	
+	if (speed < ANIMATION_SPEED_MIN || speed > ANIMATION_SPEED_MAX)
+		return -EINVAL;
+	
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	priv->config.speed = speed;
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+	
+	if (priv->animation_active)
+		animation_modes_changed(priv);
+	
+	/* Save state */
+	save_animation_state(priv);
+	
+	return count;
+}
+
+static DEVICE_ATTR(animation_mode, 0644, animation_mode_show, animation_mode_set);
+static DEVICE_ATTR(animation_speed, 0644, animation_speed_show, animation_speed_set);
+
+/*
+ * LED class integration. Each zone is a multicolor LED whose intensities are
+ * the zone color and whose brightness is a per-zone gain, so in-kernel
+ * triggers (heartbeat, disk activity, netdev, ...) blink a zone in its own
+ * color. The aggregate LED brightness scales the whole keyboard on top of
+ * the brightness attribute, like the gains it is kept out of the saved
+ * state, and is what desktop keyboard backlight controls drive. Colors set
+ * through multi_intensity are base colors and saved as such. Changes only
+ * update the state and kick the frame worker, so they are safe from the
+ * atomic contexts triggers run in and share the single-commit frame path.
+ */
+static void fourzone_led_sync(struct fourzone_priv *priv)
+{
+	struct fourzone_config cfg;
+
+	fourzone_config_get(priv, &cfg);
+	for (int i = 0; i < ARRAY_SIZE(priv->leds); i++) {
+		struct fourzone_led *led = &priv->leds[i];
+		int zone = led->zone < 0 ? 0 : led->zone;
+
+		led->color = cfg.colors[zone];
+		led->subleds[0].intensity = led->color.red;
+		led->subleds[1].intensity = led->color.green;
+		led->subleds[2].intensity = led->color.blue;
+	}
+}
+
+static void fourzone_led_set(struct led_classdev *cdev, enum led_brightness brightness)
+{
+	struct led_classdev_mc *mc = lcdev_to_mccdev(cdev);
+	struct fourzone_led *led = container_of(mc, struct fourzone_led, mc);
+	struct fourzone_priv *priv = led->priv;
+	struct color_platform color = {
+		.red = mc->subled_info[0].intensity,
+		.green = mc->subled_info[1].intensity,
+		.blue = mc->subled_info[2].intensity,
+	};
+	bool recolor = memcmp(&color, &led->color, sizeof(color));
+	unsigned long flags;
+
+	/* Keep the lighting on when the driver goes away */
+	if (cdev->flags & LED_UNREGISTERING)
+		return;
+
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	if (led->zone < 0)
+		priv->config.level = brightness;
+	else
+		priv->config.gain[led->zone] = brightness;
+
+	/* New intensities were written through multi_intensity, saved like zoneNN */
+	if (recolor) {
+		for (int zone = 0; zone < ZONE_COUNT; zone++) {
+			if (led->zone < 0 || led->zone == zone)
+				priv->config.colors[zone] = color;
+		}
+		priv->state_user_set = true;
+	}
+	write_sequnlock_irqrestore(&priv->config_lock, flags);
+	fourzone_config_changed(priv);
+
+	if (recolor) {
+		fourzone_led_sync(priv);
+		save_animation_state(priv);
+	}
+
+	/* A running animation picks the change up with its next frame */
+	animation_kick(priv);
+}
+
+static int fourzone_leds_register(struct fourzone_priv *priv)
+{
+	int ret;
+
+	for (int i = 0; i < ARRAY_SIZE(priv->leds); i++) {
+		struct fourzone_led *led = &priv->leds[i];
+
+		led->priv = priv;
+		led->zone = i < ZONE_COUNT ? i : -1;
+		led->subleds[0].color_index = LED_COLOR_ID_RED;
+		led->subleds[1].color_index = LED_COLOR_ID_GREEN;
+		led->subleds[2].color_index = LED_COLOR_ID_BLUE;
+		led->mc.subled_info = led->subleds;
+		led->mc.num_colors = ARRAY_SIZE(led->subleds);
+		led->mc.led_cdev.max_brightness = LED_FULL;
+		led->mc.led_cdev.brightness = LED_FULL;
+		led->mc.led_cdev.brightness_set = fourzone_led_set;
+		led->mc.led_cdev.flags = LED_RETAIN_AT_SHUTDOWN;
+	}
+	fourzone_led_sync(priv);
+
+	for (int i = 0; i < ARRAY_SIZE(priv->leds); i++) {
+		struct fourzone_led *led = &priv->leds[i];
+
+		if (led->zone < 0)
+			led->mc.led_cdev.name = "omen:rgb:kbd_backlight";
+		else
+			led->mc.led_cdev.name = devm_kasprintf(priv->dev, GFP_KERNEL,
+								"omen:rgb:kbd_zoned_backlight-%d",
+								led->zone);
+		if (!led->mc.led_cdev.name)
+			return -ENOMEM;
+
+		ret = devm_led_classdev_multicolor_register(priv->dev, &led->mc);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Input handler for the built-in keyboard. Events arrive in atomic context,
+ * so they only record the keypress and queue a frame.
+ */
+static void fourzone_input_event(struct input_handle *handle, unsigned int type,
+				 unsigned int code, int value)
+{
+	struct fourzone_priv *priv = handle->private;
+	struct fourzone_react *react = &priv->react;
+	unsigned long now = jiffies;
+	unsigned long flags;
+	int zone;
+
+	/* Presses only, autorepeat would turn every held key into a heat source */
+	if (type != EV_KEY || value != 1)
+		return;
+
+	idle_input(priv);
+
+	if (!priv->animation_active || !(fourzone_active_modes(priv) & REACTIVE_MODES))
+		return;
+	if (code >= ARRAY_SIZE(key_zone) || !key_zone[code])
+		return;
+	zone = key_zone[code] - 1;
+
+	spin_lock_irqsave(&priv->react_lock, flags);
+	react->zone_hit[zone] = now;
+	react->heat[zone] = min(react_heat(react, zone, now,
+					   READ_ONCE(priv->config.zone_speed[zone]) ?:
+					   READ_ONCE(priv->config.speed)) +
+				REACT_HEAT_PER_KEY, REACT_HEAT_MAX);
+	react->heat_stamp[zone] = now;
+	react->ripple_start = now;
+	react->ripple_origin = zone;
+	if (!react->pending)
+		react->pending = ktime_get();
+	spin_unlock_irqrestore(&priv->react_lock, flags);
+
+	schedule_work(&priv->animation_work);
+}
+
+static int fourzone_input_connect(struct input_handler *handler, struct input_dev *dev,
+				  const struct input_device_id *id)
+{
+	struct fourzone_priv *priv = container_of(handler, struct fourzone_priv, input_handler);
+	struct input_handle *handle;
+	int ret;
+
+	handle = kzalloc(sizeof(*handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "omen-rgb-keyboard";
+	handle->private = priv;
+
+	ret = input_register_handle(handle);
+	if (ret)
+		goto err_free;
+
+	ret = input_open_device(handle);
+	if (ret)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return ret;
+}
+
+static void fourzone_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/* The internal keyboard sits behind the i8042 controller */
+static const struct input_device_id fourzone_input_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_BUS | INPUT_DEVICE_ID_MATCH_EVBIT,
+		.bustype = BUS_I8042,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ }
+};
+
+static void fourzone_input_unregister(void *data)
+{
+	struct fourzone_priv *priv = data;
+
+	input_unregister_handler(&priv->input_handler);
+}
+
+static int fourzone_input_register(struct fourzone_priv *priv)
+{
+	int ret;
+
+	priv->input_handler.event = fourzone_input_event;
+	priv->input_handler.connect = fourzone_input_connect;
+	priv->input_handler.disconnect = fourzone_input_disconnect;
+	priv->input_handler.name = "omen-rgb-keyboard";
+	priv->input_handler.id_table = fourzone_input_ids;
+
+	ret = input_register_handler(&priv->input_handler);
+	if (ret)
+		return ret;
+
+	return devm_add_action_or_reset(priv->dev, fourzone_input_unregister, priv);
+}
+
+static ssize_t key_latency_show(struct device *dev, struct device_attribute *attr,
+				char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct fourzone_latency lat = priv->latency;
+
+	return sprintf(buf, "count=%llu last_us=%llu avg_us=%llu max_us=%llu\n",
+		       lat.count, lat.last_us,
+		       lat.count ? div64_u64(lat.total_us, lat.count) : 0,
+		       lat.max_us);
+}
+
+static DEVICE_ATTR_RO(key_latency);
+
+static ssize_t idle_timeout_show(struct device *dev, struct device_attribute *attr,
+				 char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", priv->idle_timeout);
+}
+
+static ssize_t idle_timeout_store(struct device *dev, struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned int timeout;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &timeout);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(priv->idle_timeout, timeout);
+	idle_restart(priv);
+
+	return count;
+}
+
+static ssize_t idle_fade_show(struct device *dev, struct device_attribute *attr,
+			      char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", priv->idle_fade);
+}
+
+static ssize_t idle_fade_store(struct device *dev, struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned int fade;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &fade);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(priv->idle_fade, fade);
+
+	return count;
+}
+
+static ssize_t idle_state_show(struct device *dev, struct device_attribute *attr,
+			       char *buf)
+{
+	static const char *const names[] = { "active", "fading", "dimmed" };
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", names[READ_ONCE(priv->idle_state)]);
+}
+
+static DEVICE_ATTR_RW(idle_timeout);
+static DEVICE_ATTR_RW(idle_fade);
+static DEVICE_ATTR_RO(idle_state);
+
+/*
+ * On-battery policy. power_supply notifications only queue power_work,
+ * which checks whether the system runs on AC and applies the policy for the
+ * new state. power_lock serializes it with the policy attributes.
+ */
+static void power_policy_apply(struct fourzone_priv *priv)
+{
+
+	enum battery_policy policy = priv->on_battery ? priv->battery_policy : BATTERY_POLICY_NONE;
+	bool hold = policy == BATTERY_POLICY_STATIC || policy == BATTERY_POLICY_OFF;
+
+	WRITE_ONCE(priv->fps_cap, policy == BATTERY_POLICY_FPS ? priv->battery_fps : 0);
+	if (policy == BATTERY_POLICY_DIM)
+		WRITE_ONCE(priv->brightness_cap, priv->battery_brightness);
+	else
+		WRITE_ONCE(priv->brightness_cap, policy == BATTERY_POLICY_OFF ? 0 : 100);
+
+	if (hold != priv->policy_hold) {
+		priv->policy_hold = hold;
+		stop_animation(priv);
+		start_animation(priv);
+	} else {
+		/* A running animation picks the new caps up with its next frame */
+		animation_kick(priv);
+	}
+}
+
+static void power_account(struct fourzone_priv *priv)
+{
+	unsigned long now = jiffies;
+
+	priv->power_ms[priv->on_battery] += jiffies_to_msecs(now - priv->power_since);
+	priv->power_since = now;
+}
+
+static void power_work_func(struct work_struct *work)
+{
+	struct fourzone_priv *priv = container_of(work, struct fourzone_priv, power_work);
+	/* Systems without any power supply report -ENODEV, treat them as AC */
+	bool on_battery = power_supply_is_system_supplied() == 0;
+
+	mutex_lock(&priv->power_lock);
+	if (!READ_ONCE(priv->suspended) && on_battery != priv->on_battery) {
+		power_account(priv);
+		priv->on_battery = on_battery;
+		power_policy_apply(priv);
+	}
+	mutex_unlock(&priv->power_lock);
+}
+
+static int fourzone_power_notify(struct notifier_block *nb, unsigned long event,
+				 void *data)
+{
+	struct fourzone_priv *priv = container_of(nb, struct fourzone_priv, psy_nb);
+
+	if (event == PSY_EVENT_PROP_CHANGED)
+		schedule_work(&priv->power_work);
+
+	return NOTIFY_OK;
+}
+
+static void fourzone_power_unregister(void *data)
+{
+	struct fourzone_priv *priv = data;
+
+	power_supply_unreg_notifier(&priv->psy_nb);
+	cancel_work_sync(&priv->power_work);
+}
+
+static int fourzone_power_register(struct fourzone_priv *priv)
+{
+	int ret;
+
+	priv->psy_nb.notifier_call = fourzone_power_notify;
+	ret = power_supply_reg_notifier(&priv->psy_nb);
+	if (ret)
+		return ret;
+
+	ret = devm_add_action_or_reset(priv->dev, fourzone_power_unregister, priv);
+	if (ret)
+		return ret;
+
+	/* Pick up the current state, notifications only report changes */
+	schedule_work(&priv->power_work);
+	return 0;
+}
+
+static ssize_t frame_rate_show(struct device *dev, struct device_attribute *attr,
+			       char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", priv->frame_rate);
+}
+
+static ssize_t frame_rate_store(struct device *dev, struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned int fps;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &fps);
+	if (ret)
+		return ret;
+	if (fps < 1 || fps > ANIMATION_FRAME_RATE_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(priv->frame_rate, fps);
+
+	return count;
+}
+
+static ssize_t battery_policy_show(struct device *dev, struct device_attribute *attr,
+				   char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", battery_policy_names[priv->battery_policy]);
+}
+
+static ssize_t battery_policy_store(struct device *dev, struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	int policy = sysfs_match_string(battery_policy_names, buf);
+
+	if (policy < 0)
+		return policy;
+
+	mutex_lock(&priv->power_lock);
+	priv->battery_policy = policy;
+	power_policy_apply(priv);
+	mutex_unlock(&priv->power_lock);
+
+	return count;
+}
+
+static ssize_t battery_fps_show(struct device *dev, struct device_attribute *attr,
+				char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", priv->battery_fps);
+}
+
+static ssize_t battery_fps_store(struct device *dev, struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned int fps;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &fps);
+	if (ret)
+		return ret;
+	if (fps < 1 || fps > ANIMATION_FRAME_RATE_MAX)
+		return -EINVAL;
+
+	mutex_lock(&priv->power_lock);
+	priv->battery_fps = fps;
+	power_policy_apply(priv);
+	mutex_unlock(&priv->power_lock);
+
+	return count;
+}
+
+static ssize_t battery_brightness_show(struct device *dev, struct device_attribute *attr,
+				       char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", priv->battery_brightness);
+}
+
+static ssize_t battery_brightness_store(struct device *dev, struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned int level;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &level);
+	if (ret)
+		return ret;
+
+	mutex_lock(&priv->power_lock);
+	priv->battery_brightness = min(level, 100u);
+	power_policy_apply(priv);
+	mutex_unlock(&priv->power_lock);
+
+	return count;
+}
+
+static ssize_t power_state_show(struct device *dev, struct device_attribute *attr,
+				char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	u64 ms[2];
+	bool on_battery;
+
+	mutex_lock(&priv->power_lock);
+	ms[0] = priv->power_ms[0];
+	ms[1] = priv->power_ms[1];
+	on_battery = priv->on_battery;
+	ms[on_battery] += jiffies_to_msecs(jiffies - priv->power_since);
+	mutex_unlock(&priv->power_lock);
+
+	return sprintf(buf, "state=%s policy=%s ac_ms=%llu battery_ms=%llu\n",
+		       on_battery ? "battery" : "ac",
+		       battery_policy_names[on_battery ? priv->battery_policy : BATTERY_POLICY_NONE],
+		       ms[0], ms[1]);
+}
+
+static DEVICE_ATTR_RW(frame_rate);
+static DEVICE_ATTR_RW(battery_policy);
+static DEVICE_ATTR_RW(battery_fps);
+static DEVICE_ATTR_RW(battery_brightness);
+static DEVICE_ATTR_RO(power_state);
+
+static ssize_t low_power_show(struct device *dev, struct device_attribute *attr,
+			      char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", priv->low_power);
+}
+
+static ssize_t low_power_store(struct device *dev, struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(priv->low_power, enable);
+	/* Move a running animation over to the other timer */
+	if (animation_is_continuous(priv))
+		animation_arm_timer(priv);
+
+	return count;
+}
+
+static ssize_t wakeups_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned long elapsed = jiffies - priv->wakeup_window;
+	unsigned int rate = priv->wakeup_rate;
+
+	/* The window only rolls over when the timer fires, don't report stale rates */
+	if (elapsed > 2 * HZ)
+		rate = priv->wakeup_window_count * HZ / elapsed;
+
+	return sprintf(buf, "per_sec=%u timer=%llu deferred=%llu\n",
+		       rate, priv->timer_fires, priv->timer_fires_deferred);
+}
+
+static DEVICE_ATTR_RW(low_power);
+static DEVICE_ATTR_RO(wakeups);
+
+/*
+ * Backlight hotkey. Fn+F4 switches the backlight off in firmware without
+ * touching the color buffer, frames rendered meanwhile would be invisible.
+ * The firmware reports the toggle as a WMI event and the worker parks until
+ * the backlight comes back.
+ */
+static void backlight_work_func(struct work_struct *work)
+{
+	struct fourzone_priv *priv = container_of(work, struct fourzone_priv, backlight_work);
+
+	if (READ_ONCE(priv->suspended))
+		return;
+
+	if (fourzone_read_backlight(priv))
+		return;
+	schedule_work(&priv->animation_work);
+}
+
+static void fourzone_wmi_notify(union acpi_object *obj, void *context)
+{
+	struct fourzone_priv *priv = context;
+
+	if (!obj || obj->type != ACPI_TYPE_BUFFER || obj->buffer.length < sizeof(u32))
+		return;
+
+	if (*(u32 *)obj->buffer.pointer == HPWMI_BACKLIT_KB_BRIGHTNESS)
+		schedule_work(&priv->backlight_work);
+}
+
+static void fourzone_backlight_unregister(void *data)
+{
+	struct fourzone_priv *priv = data;
+
+	wmi_remove_notify_handler(HPWMI_EVENT_GUID);
+	cancel_work_sync(&priv->backlight_work);
+}
+
+static int fourzone_backlight_register(struct fourzone_priv *priv)
+{
+	acpi_status status;
+
+	if (!wmi_has_guid(HPWMI_EVENT_GUID))
+		return -ENODEV;
+
+	status = wmi_install_notify_handler(HPWMI_EVENT_GUID, fourzone_wmi_notify, priv);
+	if (ACPI_FAILURE(status))
+		return -EIO;
+
+	return devm_add_action_or_reset(priv->dev, fourzone_backlight_unregister, priv);
+}
+
+static ssize_t parked_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	bool parked = READ_ONCE(priv->parked);
+	u64 total = priv->parked_ms;
+
+	if (parked)
+		total += jiffies_to_msecs(jiffies - priv->parked_since);
+
+	return sprintf(buf, "parked=%d total_ms=%llu\n", parked, total);
+}
+
+static DEVICE_ATTR_RO(parked);
+
+/* Firmware transactions, shared by every caller of the WMI interface */
+static ssize_t firmware_stats_show(struct device *dev, struct device_attribute *attr,
+				   char *buf)
+{
+	return sprintf(buf, "transactions=%llu contended=%llu wait_us=%llu max_wait_us=%llu depth=%d max_depth=%d\n",
+		       hp_wmi_stats.transactions, hp_wmi_stats.contended,
+		       hp_wmi_stats.wait_us, hp_wmi_stats.max_wait_us,
+		       atomic_read(&hp_wmi_stats.depth), hp_wmi_stats.max_depth);
+}
+
+static DEVICE_ATTR_RO(firmware_stats);
+
+static ssize_t stream_stats_show(struct device *dev, struct device_attribute *attr,
+				 char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "shown=%u dropped=%u torn=%llu\n",
+		       priv->stream_shown, priv->stream_dropped, priv->stream_torn);
+}
+
+static DEVICE_ATTR_RO(stream_stats);
+
+/*
+ * Scene interface. /dev/omen-rgb reads or replaces the whole configuration
+ * in one call. A scene is published to the frame worker at once, so it shows
+ * up as a single frame and a single state save, see omen_rgb.h for the ABI.
+ */
+#define SCENE_ABI_V1 1
+
+static bool fourzone_scene_version(u32 version)
+{
+	return version == SCENE_ABI_V1 || version == OMEN_RGB_ABI_VERSION;
+}
+
+static void fourzone_get_scene(struct fourzone_priv *priv, struct omen_rgb_state *st,
+			       u32 version)
+{
+	struct color_platform displayed[ZONE_COUNT];
+	struct fourzone_config cfg;
+
+	fourzone_snapshot(priv, &cfg, displayed);
+	memset(st, 0, sizeof(*st));
+	st->version = version;
+	st->mode = cfg.mode;
+	st->speed = cfg.speed;
+	st->brightness = cfg.brightness;
+	/* Reserved for version 1 callers */
+	if (version != SCENE_ABI_V1) {
+		memcpy(st->zone_mode, cfg.zone_mode, sizeof(st->zone_mode));
+		memcpy(st->zone_speed, cfg.zone_speed, sizeof(st->zone_speed));
+	}
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		st->colors[zone].red = cfg.colors[zone].red;
+		st->colors[zone].green = cfg.colors[zone].green;
+		st->colors[zone].blue = cfg.colors[zone].blue;
+		st->frame[zone].red = displayed[zone].red;
+		st->frame[zone].green = displayed[zone].green;
+		st->frame[zone].blue = displayed[zone].blue;
+	}
+}
+
+static int fourzone_set_scene(struct fourzone_priv *priv, const struct omen_rgb_state *st)
+{
+	unsigned long flags;
+
+	if (st->flags & ~(OMEN_RGB_SET_ALL | OMEN_RGB_SET_ZONES))
+		return -EINVAL;
+	if (memchr_inv(st->reserved, 0, sizeof(st->reserved)))
+		return -EINVAL;
+	if (st->version == SCENE_ABI_V1 &&
+	    ((st->flags & OMEN_RGB_SET_ZONES) ||
+	     memchr_inv(st->zone_mode, 0, sizeof(st->zone_mode)) ||
+	     memchr_inv(st->zone_speed, 0, sizeof(st->zone_speed))))
+		return -EINVAL;
+	if (st->flags & OMEN_RGB_SET_ZONES) {
+		for (int zone = 0; zone < ZONE_COUNT; zone++) {
+			if (st->zone_mode[zone] >= ANIMATION_COUNT &&
+			    st->zone_mode[zone] != ZONE_MODE_GLOBAL)
+				return -EINVAL;
+			if (st->zone_speed[zone] > ANIMATION_SPEED_MAX)
+				return -EINVAL;
+		}
 	}
-	if (state.speed >= ANIMATION_SPEED_MIN && state.speed <= ANIMATION_SPEED_MAX) {
-		animation_speed = state.speed;
+	if ((st->flags & OMEN_RGB_SET_MODE) && st->mode >= ANIMATION_COUNT)
+		return -EINVAL;
+	if ((st->flags & OMEN_RGB_SET_SPEED) &&
+	    (st->speed < ANIMATION_SPEED_MIN || st->speed > ANIMATION_SPEED_MAX))
+		return -EINVAL;
+	if ((st->flags & OMEN_RGB_SET_BRIGHTNESS) && st->brightness > 100)
+		return -EINVAL;
+
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	if (st->flags & OMEN_RGB_SET_MODE)
+		priv->config.mode = st->mode;
+	if (st->flags & OMEN_RGB_SET_SPEED)
+		priv->config.speed = st->speed;
+	if (st->flags & OMEN_RGB_SET_BRIGHTNESS)
+		priv->config.brightness = st->brightness;
+	if (st->flags & OMEN_RGB_SET_ZONES) {
+		memcpy(priv->config.zone_mode, st->zone_mode, sizeof(st->zone_mode));
+		memcpy(priv->config.zone_speed, st->zone_speed, sizeof(st->zone_speed));
 	}
-	if (state.brightness >= 0 && state.brightness <= 100) {
-		global_brightness = state.brightness;
+	if (st->flags & OMEN_RGB_SET_COLORS) {
+		for (int zone = 0; zone < ZONE_COUNT; zone++) {
+			priv->config.colors[zone].red = st->colors[zone].red;
+			priv->config.colors[zone].green = st->colors[zone].green;
+			priv->config.colors[zone].blue = st->colors[zone].blue;
+		}
 	}
-	
-	/* Restore colors */
-	for (int i = 0; i < ZONE_COUNT; i++) {
-		original_colors[i].colors = state.colors[i];
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+
+	/* Anything but a new mode or speed is picked up by the next frame */
+	if (st->flags & (OMEN_RGB_SET_MODE | OMEN_RGB_SET_SPEED | OMEN_RGB_SET_ZONES)) {
+		animation_modes_changed(priv);
+	} else {
+		animation_kick(priv);
 	}
-	
-	pr_info("Animation state loaded: mode=%d, speed=%d, brightness=%d\n", 
-		current_animation, animation_speed, global_brightness);
+
+	fourzone_led_sync(priv);
+	save_animation_state(priv);
+	return 0;
 }
 
-/* Animation work function - runs in work queue context */
-static void animation_work_func(struct work_struct *work)
+static long fourzone_misc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
-	if (!animation_active || current_animation == ANIMATION_STATIC)
-		return;
-	
-	switch (current_animation) {
-	case ANIMATION_BREATHING:
-		animation_breathing();
-		break;
-	case ANIMATION_RAINBOW:
-		animation_rainbow();
-		break;
-	case ANIMATION_WAVE:
-		animation_wave();
-		break;
-	case ANIMATION_PULSE:
-		animation_pulse();
-		break;
-	case ANIMATION_CHASE:
-		animation_chase();
-		break;
-	case ANIMATION_SPARKLE:
-		animation_sparkle();
-		break;
-	case ANIMATION_CANDLE:
-		animation_candle();
-		break;
-	case ANIMATION_AURORA:
-		animation_aurora();
-		break;
-	case ANIMATION_DISCO:
-		animation_disco();
-		break;
+	struct fourzone_priv *priv = container_of(file->private_data, struct fourzone_priv, misc);
+	void __user *argp = (void __user *)arg;
+	struct omen_rgb_state st;
+	u32 version;
+
+	switch (cmd) {
+	case OMEN_RGB_IOC_VERSION:
+		version = OMEN_RGB_ABI_VERSION;
+		return put_user(version, (u32 __user *)argp);
+	case OMEN_RGB_IOC_GET_STATE:
+		if (get_user(version, (u32 __user *)argp))
+			return -EFAULT;
+		if (!fourzone_scene_version(version))
+			return -EINVAL;
+		fourzone_get_scene(priv, &st, version);
+		return copy_to_user(argp, &st, sizeof(st)) ? -EFAULT : 0;
+	case OMEN_RGB_IOC_SET_STATE:
+		if (copy_from_user(&st, argp, sizeof(st)))
+			return -EFAULT;
+		if (!fourzone_scene_version(st.version))
+			return -EINVAL;
+		return fourzone_set_scene(priv, &st);
 	default:
-		break;
+		return -ENOTTY;
 	}
 }
 
-/* Animation timer callback */
-static void animation_timer_callback(struct timer_list *t)
+/* Maps the frame ring, see struct omen_rgb_ring */
+static int fourzone_misc_mmap(struct file *file, struct vm_area_struct *vma)
 {
-	if (animation_active && current_animation != ANIMATION_STATIC) {
-		schedule_work(&animation_work);
-		mod_timer(&animation_timer, jiffies + msecs_to_jiffies(ANIMATION_TIMER_INTERVAL_MS));
-	}
+	struct fourzone_priv *priv = container_of(file->private_data, struct fourzone_priv, misc);
+
+	if (!priv->ring)
+		return -ENODEV;
+
+	return remap_vmalloc_range(vma, priv->ring, vma->vm_pgoff);
 }
 
-static void start_animation(void)
+static const struct file_operations fourzone_misc_fops = {
+	.owner = THIS_MODULE,
+	.unlocked_ioctl = fourzone_misc_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.mmap = fourzone_misc_mmap,
+};
+
+static void fourzone_misc_unregister(void *data)
 {
-	if (current_animation == ANIMATION_STATIC) {
-		animation_active = false;
-		return;
-	}
-	
-	animation_start_time = jiffies;
-	animation_active = true;
-	
-	/* Start the timer */
-	timer_setup(&animation_timer, animation_timer_callback, 0);
-	mod_timer(&animation_timer, jiffies + msecs_to_jiffies(ANIMATION_TIMER_INTERVAL_MS));
+	struct fourzone_priv *priv = data;
+
+	misc_deregister(&priv->misc);
 }
 
-static void stop_animation(void)
+static void fourzone_ring_free(void *data)
 {
-	animation_active = false;
-	timer_delete(&animation_timer);
-	
-	/* Restore original colors */
-	for (int zone = 0; zone < ZONE_COUNT; zone++) {
-		zone_data[zone].colors = original_colors[zone].colors;
-		apply_brightness_to_color(&zone_data[zone].colors);
-		fourzone_update_led(&zone_data[zone], HPWMI_WRITE);
-	}
+	vfree(data);
 }
 
-static ssize_t all_show(struct device *dev, struct device_attribute *attr,
-												char *buf)
+/* Allocated ahead of the teardown action, so the worker is stopped before it goes away */
+static int fourzone_ring_alloc(struct fourzone_priv *priv)
 {
+	struct omen_rgb_ring *ring;
 	int ret;
-	ret = fourzone_update_led(&zone_data[0], HPWMI_READ);
+
+	ring = vmalloc_user(PAGE_ALIGN(sizeof(*ring)));
+	if (!ring)
+		return -ENOMEM;
+	ring->version = OMEN_RGB_RING_VERSION;
+	ring->slots = OMEN_RGB_RING_SLOTS;
+
+	ret = devm_add_action_or_reset(priv->dev, fourzone_ring_free, ring);
 	if (ret)
-		return sprintf(buf, "red: -1, green: -1, blue: -1\n");
-	return sprintf(buf, "#%02x%02x%02x\n",
-							 zone_data[0].colors.red,
-							 zone_data[0].colors.green, zone_data[0].colors.blue);
+		return ret;
+
+	priv->ring = ring;
+	return 0;
 }
 
-static ssize_t all_set(struct device *dev, struct device_attribute *attr,
-											 const char *buf, size_t count)
+static int fourzone_misc_register(struct fourzone_priv *priv)
 {
-	struct platform_zone temp;
 	int ret;
-	u8 z;
 
-	ret = parse_rgb(buf, &temp);
+	priv->misc.minor = MISC_DYNAMIC_MINOR;
+	priv->misc.name = "omen-rgb";
+	priv->misc.fops = &fourzone_misc_fops;
+	priv->misc.parent = priv->dev;
+
+	ret = misc_register(&priv->misc);
 	if (ret)
 		return ret;
 
-	stop_animation();
-	current_animation = ANIMATION_STATIC;
+	return devm_add_action_or_reset(priv->dev, fourzone_misc_unregister, priv);
+}
 
-	for (z = 0; z < ZONE_COUNT; z++)
-	{
-		/* Store the new color as the original color */
-		original_colors[z].colors = temp.colors;
+/*
+ * The whole lighting state in one read, as text or as the struct
+ * omen_rgb_state of the ioctl interface. Both come from one snapshot, so
+ * the configuration and the frame always match.
+ */
+static ssize_t state_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct color_platform displayed[ZONE_COUNT];
+	struct fourzone_config cfg;
+	ssize_t len;
 
-		zone_data[z].colors.red = (temp.colors.red * global_brightness) / 100;
-		zone_data[z].colors.green = (temp.colors.green * global_brightness) / 100;
-		zone_data[z].colors.blue = (temp.colors.blue * global_brightness) / 100;
+	fourzone_snapshot(priv, &cfg, displayed);
 
-		ret = fourzone_update_led(&zone_data[z], HPWMI_WRITE);
-		if (ret)
-			return ret;
-	}
+	len = sprintf(buf, "mode=%s speed=%d brightness=%d colors=",
+		      cfg.mode < ANIMATION_COUNT ? animation_mode_names[cfg.mode] : "unknown",
+		      cfg.speed, cfg.brightness);
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		len += sprintf(buf + len, "%s%02x%02x%02x", zone ? "," : "",
+			       cfg.colors[zone].red, cfg.colors[zone].green, cfg.colors[zone].blue);
+	len += sprintf(buf + len, " zone_modes=");
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		len += sprintf(buf + len, "%s%s", zone ? "," : "",
+			       cfg.zone_mode[zone] == ZONE_MODE_GLOBAL ? "global" :
+			       animation_mode_names[cfg.zone_mode[zone]]);
+	len += sprintf(buf + len, " zone_speeds=");
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		len += sprintf(buf + len, "%s%u", zone ? "," : "", cfg.zone_speed[zone]);
+	len += sprintf(buf + len, " displayed=");
+	for (int zone = 0; zone < ZONE_COUNT; zone++)
+		len += sprintf(buf + len, "%s%02x%02x%02x", zone ? "," : "",
+			       displayed[zone].red, displayed[zone].green, displayed[zone].blue);
 
-	/* Save state */
-	save_animation_state();
+	return len + sprintf(buf + len, "\n");
+}
 
-	return count;
+static DEVICE_ATTR_RO(state);
+
+static ssize_t state_bin_read(struct file *file, struct kobject *kobj,
+			      FOURZONE_BIN_CONST struct bin_attribute *attr, char *buf,
+			      loff_t off, size_t count)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(kobj_to_dev(kobj));
+	struct omen_rgb_state st;
+
+	fourzone_get_scene(priv, &st, OMEN_RGB_ABI_VERSION);
+	return memory_read_from_buffer(buf, count, &off, &st, sizeof(st));
 }
 
-/* Animation control sysfs attributes */
-static ssize_t animation_mode_show(struct device *dev, struct device_attribute *attr,
-																	char *buf)
+static FOURZONE_BIN_CONST BIN_ATTR_RO(state_bin, sizeof(struct omen_rgb_state));
+
+static DEVICE_ATTR(all, 0644, all_show, all_set);
+
+/* Per-zone mode, "global" follows animation_mode */
+static ssize_t zone_mode_show(struct device *dev, struct device_attribute *attr,
+			      char *buf)
 {
-	const char *mode_names[] = {
-		"static", "breathing", "rainbow", "wave", "pulse", 
-		"chase", "sparkle", "candle", "aurora", "disco"
-	};
-	
-	if (current_animation >= ANIMATION_COUNT)
-		return sprintf(buf, "unknown\n");
-	
-	return sprintf(buf, "%s\n", mode_names[current_animation]);
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct platform_zone *target_zone = match_zone(priv, attr);
+	u8 mode;
+
+	if (target_zone == NULL)
+		return -EINVAL;
+
+	mode = READ_ONCE(priv->config.zone_mode[target_zone - priv->zone_data]);
+	if (mode == ZONE_MODE_GLOBAL)
+		return sprintf(buf, "global\n");
+	return sprintf(buf, "%s\n", animation_mode_names[mode]);
 }
 
-static ssize_t animation_mode_set(struct device *dev, struct device_attribute *attr,
-																const char *buf, size_t count)
+static ssize_t zone_mode_store(struct device *dev, struct device_attribute *attr,
+			       const char *buf, size_t count)
 {
-	enum animation_mode new_mode = ANIMATION_STATIC;
-	
-	if (strncmp(buf, "static", 6) == 0) {
-		new_mode = ANIMATION_STATIC;
-	} else if (strncmp(buf, "breathing", 9) == 0) {
-		new_mode = ANIMATION_BREATHING;
-	} else if (strncmp(buf, "rainbow", 7) == 0) {
-		new_mode = ANIMATION_RAINBOW;
-	} else if (strncmp(buf, "wave", 4) == 0) {
-		new_mode = ANIMATION_WAVE;
-	} else if (strncmp(buf, "pulse", 5) == 0) {
-		new_mode = ANIMATION_PULSE;
-	} else if (strncmp(buf, "chase", 5) == 0) {
-		new_mode = ANIMATION_CHASE;
-	} else if (strncmp(buf, "sparkle", 7) == 0) {
-		new_mode = ANIMATION_SPARKLE;
-	} else if (strncmp(buf, "candle", 6) == 0) {
-		new_mode = ANIMATION_CANDLE;
-	} else if (strncmp(buf, "aurora", 6) == 0) {
-		new_mode = ANIMATION_AURORA;
-	} else if (strncmp(buf, "disco", 5) == 0) {
-		new_mode = ANIMATION_DISCO;
-	} else {
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct platform_zone *target_zone = match_zone(priv, attr);
+	unsigned long flags;
+	int mode;
+
+	if (target_zone == NULL)
 		return -EINVAL;
-	}
-	
-	stop_animation();
-	
-	current_animation = new_mode;
-	
-	if (new_mode != ANIMATION_STATIC) {
-		start_animation();
-	}
-	
+
+	mode = sysfs_streq(buf, "global") ? ZONE_MODE_GLOBAL : parse_animation_mode(buf);
+	if (mode < 0)
+		return mode;
+
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	priv->config.zone_mode[target_zone - priv->zone_data] = mode;
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+	animation_modes_changed(priv);
+
 	/* Save state */
-	save_animation_state();
-	
+	save_animation_state(priv);
+
 	return count;
 }
 
-static ssize_t animation_speed_show(struct device *dev, struct device_attribute *attr,
-																	char *buf)
+/* Per-zone speed, 0 follows animation_speed */
+static ssize_t zone_speed_show(struct device *dev, struct device_attribute *attr,
+			       char *buf)
 {
-	return sprintf(buf, "%d\n", animation_speed);
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct platform_zone *target_zone = match_zone(priv, attr);
+
+	if (target_zone == NULL)
+		return -EINVAL;
+
+	return sprintf(buf, "%d\n",
+		       READ_ONCE(priv->config.zone_speed[target_zone - priv->zone_data]));
 }
 
-static ssize_t animation_speed_set(struct device *dev, struct device_attribute *attr,
-																const char *buf, size_t count)
+static ssize_t zone_speed_store(struct device *dev, struct device_attribute *attr,
+				const char *buf, size_t count)
 {
-	unsigned long speed;
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	struct platform_zone *target_zone = match_zone(priv, attr);
+	unsigned long flags;
+	unsigned int speed;
 	int ret;
-	
-	ret = kstrtoul(buf, 10, &speed);
+
+	if (target_zone == NULL)
+		return -EINVAL;
+
+	ret = kstrtouint(buf, 10, &speed);
 	if (ret)
 		return ret;
-	
-	if (speed < ANIMATION_SPEED_MIN || speed > ANIMATION_SPEED_MAX)
+	if (speed && (speed < ANIMATION_SPEED_MIN || speed > ANIMATION_SPEED_MAX))
 		return -EINVAL;
-	
-	animation_speed = speed;
-	
-	if (animation_active && current_animation != ANIMATION_STATIC) {
-		stop_animation();
-		start_animation();
-	}
-	
+
+	write_seqlock_irqsave(&priv->config_lock, flags);
+	priv->config.zone_speed[target_zone - priv->zone_data] = speed;
+	fourzone_config_user_unlock(priv, flags);
+	fourzone_config_changed(priv);
+	animation_kick(priv);
+
 	/* Save state */
-	save_animation_state();
-	
+	save_animation_state(priv);
+
 	return count;
 }
 
-static DEVICE_ATTR(animation_mode, 0644, animation_mode_show, animation_mode_set);
-static DEVICE_ATTR(animation_speed, 0644, animation_speed_show, animation_speed_set);
+/* Zone attributes carry their zone index, see match_zone() */
+#define FOURZONE_ZONE_ATTR(_zone)                                    \
+	static struct dev_ext_attribute dev_attr_zone0##_zone = {          \
+		.attr = __ATTR(zone0##_zone, 0644, zone_show, zone_set),         \
+		.var = (void *)_zone,                                            \
+	};                                                                 \
+	static struct dev_ext_attribute dev_attr_zone0##_zone##_mode = {   \
+		.attr = __ATTR(zone0##_zone##_mode, 0644, zone_mode_show,        \
+			       zone_mode_store),                                       \
+		.var = (void *)_zone,                                            \
+	};                                                                 \
+	static struct dev_ext_attribute dev_attr_zone0##_zone##_speed = {  \
+		.attr = __ATTR(zone0##_zone##_speed, 0644, zone_speed_show,      \
+			       zone_speed_store),                                      \
+		.var = (void *)_zone,                                            \
+	}
 
-static int fourzone_setup(struct platform_device *dev)
+FOURZONE_ZONE_ATTR(0);
+FOURZONE_ZONE_ATTR(1);
+FOURZONE_ZONE_ATTR(2);
+FOURZONE_ZONE_ATTR(3);
+
+static struct attribute *fourzone_attrs[] = {
+	&dev_attr_zone00.attr.attr,
+	&dev_attr_zone01.attr.attr,
+	&dev_attr_zone02.attr.attr,
+	&dev_attr_zone03.attr.attr,
+	&dev_attr_zone00_mode.attr.attr,
+	&dev_attr_zone01_mode.attr.attr,
+	&dev_attr_zone02_mode.attr.attr,
+	&dev_attr_zone03_mode.attr.attr,
+	&dev_attr_zone00_speed.attr.attr,
+	&dev_attr_zone01_speed.attr.attr,
+	&dev_attr_zone02_speed.attr.attr,
+	&dev_attr_zone03_speed.attr.attr,
+	&dev_attr_all.attr,
+	&dev_attr_brightness.attr,
+	&dev_attr_animation_mode.attr,
+	&dev_attr_animation_speed.attr,
+	&dev_attr_key_latency.attr,
+	&dev_attr_idle_timeout.attr,
+	&dev_attr_idle_fade.attr,
+	&dev_attr_idle_state.attr,
+	&dev_attr_frame_rate.attr,
+	&dev_attr_battery_policy.attr,
+	&dev_attr_battery_fps.attr,
+	&dev_attr_battery_brightness.attr,
+	&dev_attr_power_state.attr,
+	&dev_attr_low_power.attr,
+	&dev_attr_wakeups.attr,
+	&dev_attr_parked.attr,
+	&dev_attr_firmware_stats.attr,
+	&dev_attr_stream_stats.attr,
+	&dev_attr_displayed.attr,
+	&dev_attr_hw_readback.attr,
+	&dev_attr_state.attr,
+	&dev_attr_frame.attr,
+	&dev_attr_gamma.attr,
+	&dev_attr_calibration.attr,
+	&dev_attr_dither.attr,
+	&dev_attr_transition_ms.attr,
+	&dev_attr_seed.attr,
+	NULL
+};
+
+static FOURZONE_BIN_CONST struct bin_attribute *fourzone_bin_attrs[] = {
+	&bin_attr_state_bin,
+	NULL,
+};
+
+static const struct attribute_group fourzone_group = {
+		.name = "rgb_zones",
+		.attrs = fourzone_attrs,
+		.bin_attrs = fourzone_bin_attrs,
+};
+__ATTRIBUTE_GROUPS(fourzone);
+
+static void fourzone_teardown(void *data)
 {
-	u8 zone;
-	char buffer[10];
-	char *name;
+	struct fourzone_priv *priv = data;
 
-	INIT_WORK(&animation_work, animation_work_func);
+	cancel_delayed_work_sync(&priv->idle_work);
+	flush_delayed_work(&priv->save_work);
+	cancel_work_sync(&priv->notify_work);
+	stop_animation(priv);
+	flush_work(&priv->animation_work);
 	
-	/* Load saved state */
-	load_animation_state();
+	/* Cancel any pending work, nothing may re-arm the timers from here on */
+	WRITE_ONCE(priv->suspended, true);
+	animation_delete_timers(priv, true);
+	cancel_work_sync(&priv->animation_work);
+}
 
-	zone_dev_attrs = kcalloc(ZONE_COUNT + 4, sizeof(struct device_attribute),
-													 GFP_KERNEL);
-	if (!zone_dev_attrs)
-		return -ENOMEM;
+static int fourzone_setup(struct platform_device *dev)
+{
+	struct fourzone_priv *priv;
+	int ret;
 
-	zone_attrs = kcalloc(ZONE_COUNT + 5, sizeof(struct attribute *),
-											 GFP_KERNEL);
-	if (!zone_attrs)
+	priv = devm_kzalloc(&dev->dev, sizeof(*priv), GFP_KERNEL);
+	if (!priv)
 		return -ENOMEM;
 
-	zone_data = kcalloc(ZONE_COUNT, sizeof(struct platform_zone),
-											GFP_KERNEL);
-	if (!zone_data)
-		return -ENOMEM;
+	priv->dev = &dev->dev;
+	seqlock_init(&priv->config_lock);
+	priv->config.brightness = 100;
+	priv->config.mode = ANIMATION_STATIC;
+	priv->config.speed = ANIMATION_SPEED_DEFAULT;
+	timer_setup(&priv->animation_timer, animation_timer_callback, 0);
+	timer_setup(&priv->animation_timer_lp, animation_timer_lp_callback, TIMER_DEFERRABLE);
+	priv->low_power = low_power;
+	priv->wakeup_window = jiffies;
+	INIT_WORK(&priv->animation_work, animation_work_func);
+	INIT_WORK(&priv->notify_work, notify_work_func);
+	spin_lock_init(&priv->react_lock);
+	react_reset(priv);
+	INIT_DELAYED_WORK(&priv->idle_work, idle_work_func);
+	INIT_DELAYED_WORK(&priv->save_work, save_work_func);
+	priv->idle_timeout = idle_timeout;
+	priv->idle_fade = idle_fade;
+	priv->last_input = jiffies;
+	priv->output_level = 100;
+	priv->frame_rate = ANIMATION_FRAME_RATE_DEFAULT;
+	priv->battery_fps = 10;
+	priv->battery_brightness = 30;
+	priv->brightness_cap = 100;
+	priv->power_since = jiffies;
+	mutex_init(&priv->power_lock);
+	INIT_WORK(&priv->power_work, power_work_func);
+	INIT_WORK(&priv->backlight_work, backlight_work_func);
+	if (battery_policy && *battery_policy) {
+		ret = match_string(battery_policy_names, BATTERY_POLICY_COUNT, battery_policy);
+		if (ret < 0)
+			pr_warn("Ignoring unknown battery_policy parameter '%s'\n", battery_policy);
+		else
+			priv->battery_policy = ret;
+	}
+	platform_set_drvdata(dev, priv);
 
+	priv->config.level = LED_FULL;
 	for (u8 zone = 0; zone < ZONE_COUNT; zone++)
 	{
-		zone_data[zone].offset = 25 + (zone * 3);
-		int ret = fourzone_update_led(&zone_data[zone], HPWMI_READ);
-		if (ret)
-			return ret;
-
-		/* Store original colors */
-		original_colors[zone].colors.red = zone_data[zone].colors.red;
-		original_colors[zone].colors.green = zone_data[zone].colors.green;
-		original_colors[zone].colors.blue = zone_data[zone].colors.blue;
+		priv->zone_data[zone].offset = 25 + (zone * 3);
+		priv->config.gain[zone] = LED_FULL;
+		memcpy(priv->config.calib[zone], calib_identity, sizeof(calib_identity));
+		priv->config.zone_mode[zone] = ZONE_MODE_GLOBAL;
 	}
 
-	for (zone = 0; zone < ZONE_COUNT; zone++)
-	{
-		sprintf(buffer, "zone%02hhX", zone);
-		name = kstrdup(buffer, GFP_KERNEL);
-		if (!name)
-			return -ENOMEM;
+	ret = fourzone_read_state(priv);
+	if (ret)
+		return ret;
+
+	/* Store original colors */
+	for (u8 zone = 0; zone < ZONE_COUNT; zone++)
+		priv->config.colors[zone] = priv->zone_data[zone].colors;
+
+	/* Not every model reports the backlight state, assume it is on */
+	fourzone_read_backlight(priv);
+
+	/* The stream mode shows the base colors without a ring */
+	ret = fourzone_ring_alloc(priv);
+	if (ret)
+		dev_warn(&dev->dev, "Failed to allocate the frame ring: %d\n", ret);
+
+	ret = devm_add_action_or_reset(&dev->dev, fourzone_teardown, priv);
+	if (ret)
+		return ret;
 
-		sysfs_attr_init(&zone_dev_attrs[zone].attr);
-		zone_dev_attrs[zone].attr.name = name;
-		zone_dev_attrs[zone].attr.mode = 0644;
-		zone_dev_attrs[zone].show = zone_show;
-		zone_dev_attrs[zone].store = zone_set;
-		zone_data[zone].offset = 25 + (zone * 3);
-		zone_attrs[zone] = &zone_dev_attrs[zone].attr;
-		zone_data[zone].attr = &zone_dev_attrs[zone];
-	}
-
-	sysfs_attr_init(&zone_dev_attrs[ZONE_COUNT].attr);
-	zone_dev_attrs[ZONE_COUNT].attr.name = "all";
-	zone_dev_attrs[ZONE_COUNT].attr.mode = 0644;
-	zone_dev_attrs[ZONE_COUNT].show = all_show;
-	zone_dev_attrs[ZONE_COUNT].store = all_set;
-	zone_attrs[ZONE_COUNT] = &zone_dev_attrs[ZONE_COUNT].attr;
-
-	zone_attrs[ZONE_COUNT + 1] = &dev_attr_brightness.attr;
-	zone_attrs[ZONE_COUNT + 2] = &dev_attr_animation_mode.attr;
-	zone_attrs[ZONE_COUNT + 3] = &dev_attr_animation_speed.attr;
-	zone_attrs[ZONE_COUNT + 4] = NULL; /* NULL terminate the array */
-
-	zone_attribute_group.attrs = zone_attrs;
+	if (priv->idle_timeout)
+		schedule_delayed_work(&priv->idle_work, secs_to_jiffies(priv->idle_timeout));
+	
+	/* Nothing else runs yet, the configuration can be set up in place */
+	if (apply_module_params(&priv->config) || priv->config.mode != ANIMATION_STATIC)
+		apply_initial_state(priv);
+	priv->notified = priv->config;
+	
+	/* Lighting keeps working through sysfs without LED class support */
+	ret = fourzone_leds_register(priv);
+	if (ret)
+		dev_warn(&dev->dev, "Failed to register LED class devices: %d\n", ret);
+	
+	ret = fourzone_power_register(priv);
+	if (ret)
+		dev_warn(&dev->dev, "Failed to register power supply notifier: %d\n", ret);
+	
+	/* Reactive effects stay idle without keypress input */
+	ret = fourzone_input_register(priv);
+	if (ret)
+		dev_warn(&dev->dev, "Failed to register input handler: %d\n", ret);
+	
+	/* Without hotkey events frames keep being rendered while the backlight is off */
+	ret = fourzone_backlight_register(priv);
+	if (ret)
+		dev_warn(&dev->dev, "Failed to register backlight event handler: %d\n", ret);
+	
+	ret = fourzone_misc_register(priv);
+	if (ret)
+		dev_warn(&dev->dev, "Failed to register /dev/omen-rgb: %d\n", ret);
 	
-	if (current_animation != ANIMATION_STATIC) {
-		start_animation();
+	/* Saved profile arrives asynchronously, never blocking the probe */
+	if (profile && *profile) {
+		ret = request_firmware_nowait(THIS_MODULE, FW_ACTION_NOUEVENT, profile,
+					      &dev->dev, GFP_KERNEL, priv,
+					      load_animation_state);
+		if (ret)
+			pr_warn("Failed to request saved animation state: %d\n", ret);
 	}
 	
-	return sysfs_create_group(&dev->dev.kobj, &zone_attribute_group);
+	return 0;
+}
+
+/*
+ * System sleep. Everything that can touch the hardware is quiesced on the
+ * way down. Firmware may reset the colors across S3, s2idle or hibernation,
+ * so resume rereads the firmware buffer and restores the frame with a single
+ * commit before the effect continues where it left off.
+ */
+static int fourzone_suspend(struct device *dev)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+
+	WRITE_ONCE(priv->suspended, true);
+	priv->suspended_phase = jiffies - priv->animation_start_time;
+
+	animation_delete_timers(priv, true);
+	cancel_work_sync(&priv->animation_work);
+	cancel_delayed_work_sync(&priv->idle_work);
+	cancel_work_sync(&priv->power_work);
+	cancel_work_sync(&priv->backlight_work);
+	flush_delayed_work(&priv->save_work);
+
+	return 0;
 }
 
+static int fourzone_resume(struct device *dev)
+{
+	struct fourzone_priv *priv = dev_get_drvdata(dev);
+	unsigned long flags;
+	int ret;
+
+	ret = fourzone_read_state(priv);
+	if (ret)
+		dev_warn(dev, "Failed to read lighting state on resume: %d\n", ret);
+
+	/* Waking up counts as activity */
+	spin_lock_irqsave(&priv->react_lock, flags);
+	priv->idle_state = IDLE_ACTIVE;
+	spin_unlock_irqrestore(&priv->react_lock, flags);
+	priv->last_input = jiffies;
+
+	priv->animation_start_time = jiffies - priv->suspended_phase;
+	WRITE_ONCE(priv->suspended, false);
+
+	/* The hotkey may have been used while asleep */
+	fourzone_read_backlight(priv);
+	schedule_work(&priv->animation_work);
+
+	if (animation_is_continuous(priv))
+		animation_arm_timer(priv);
+	if (priv->idle_timeout)
+		schedule_delayed_work(&priv->idle_work, secs_to_jiffies(priv->idle_timeout));
+
+	/* The power source may have changed while asleep */
+	schedule_work(&priv->power_work);
+
+	return 0;
+}
+
+static DEFINE_SIMPLE_DEV_PM_OPS(fourzone_pm_ops, fourzone_suspend, fourzone_resume);
+
 static struct platform_device *hp_wmi_platform_dev;
 
 static int __init hp_wmi_bios_setup(struct platform_device *device)
@@ -1052,8 +4423,9 @@ static int __init hp_wmi_bios_setup(struct platform_device *device)
 static struct platform_driver hp_wmi_driver = {
 		.driver = {
 				.name = "omen-rgb-keyboard",
+				.dev_groups = fourzone_groups,
+				.pm = pm_sleep_ptr(&fourzone_pm_ops),
 		},
-		.remove = NULL,
 };
 
 static int __init hp_wmi_init(void)
@@ -1079,11 +4451,7 @@ module_init(hp_wmi_init);
 
 static void __exit hp_wmi_exit(void)
 {
-	stop_animation();
-	
-	/* Cancel any pending work */
-	cancel_work_sync(&animation_work);
-	
+	/* Unbinding stops the animation and releases the per-device state */
 	if (hp_wmi_platform_dev)
 	{
 		platform_device_unregister(hp_wmi_platform_dev);
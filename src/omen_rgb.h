@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Userspace interface of /dev/omen-rgb.
+ *
+ * A whole scene (colors, brightness, mode and speed) is applied with a
+ * single OMEN_RGB_IOC_SET_STATE call and shows up as one frame. Every
+ * structure starts with the ABI version it was built against, the driver
+ * rejects versions it does not know. Reserved fields must be zero.
+ *
+ * Version 2 adds the per-zone mode and speed. Version 1 callers are still
+ * served, for them the per-zone fields are reserved. The frame ring is
+ * versioned on its own, see OMEN_RGB_RING_VERSION.
+ */
+#ifndef _UAPI_OMEN_RGB_H
+#define _UAPI_OMEN_RGB_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define OMEN_RGB_ABI_VERSION 2
+#define OMEN_RGB_ZONES 4
+
+/* Same order as the names accepted by the animation_mode attribute */
+enum omen_rgb_mode {
+	OMEN_RGB_MODE_STATIC = 0,
+	OMEN_RGB_MODE_BREATHING,
+	OMEN_RGB_MODE_RAINBOW,
+	OMEN_RGB_MODE_WAVE,
+	OMEN_RGB_MODE_PULSE,
+	OMEN_RGB_MODE_CHASE,
+	OMEN_RGB_MODE_SPARKLE,
+	OMEN_RGB_MODE_CANDLE,
+	OMEN_RGB_MODE_AURORA,
+	OMEN_RGB_MODE_DISCO,
+	OMEN_RGB_MODE_REACTIVE,
+	OMEN_RGB_MODE_RIPPLE,
+	OMEN_RGB_MODE_HEATMAP,
+	OMEN_RGB_MODE_STREAM,
+	OMEN_RGB_MODE_COUNT
+};
+
+/* zone_mode value of a zone that follows mode */
+#define OMEN_RGB_ZONE_GLOBAL 0xff
+
+struct omen_rgb_color {
+	__u8 red;
+	__u8 green;
+	__u8 blue;
+	__u8 reserved;
+};
+
+/* Which fields of struct omen_rgb_state OMEN_RGB_IOC_SET_STATE applies */
+#define OMEN_RGB_SET_COLORS		(1U << 0)
+#define OMEN_RGB_SET_BRIGHTNESS		(1U << 1)
+#define OMEN_RGB_SET_MODE		(1U << 2)
+#define OMEN_RGB_SET_SPEED		(1U << 3)
+#define OMEN_RGB_SET_ALL		(OMEN_RGB_SET_COLORS | OMEN_RGB_SET_BRIGHTNESS | \
+					 OMEN_RGB_SET_MODE | OMEN_RGB_SET_SPEED)
+/*
+ * zone_mode and zone_speed, version 2. Not part of OMEN_RGB_SET_ALL, so a
+ * zeroed state does not turn every zone static.
+ */
+#define OMEN_RGB_SET_ZONES		(1U << 4)
+
+struct omen_rgb_state {
+	__u32 version;		/* OMEN_RGB_ABI_VERSION */
+	__u32 flags;		/* OMEN_RGB_SET_*, ignored by GET_STATE */
+	__u32 mode;		/* enum omen_rgb_mode */
+	__u32 speed;		/* 1 - 10 */
+	__u32 brightness;	/* Percent */
+	__u8 zone_mode[OMEN_RGB_ZONES];	/* enum omen_rgb_mode or OMEN_RGB_ZONE_GLOBAL */
+	__u8 zone_speed[OMEN_RGB_ZONES];	/* 1 - 10, 0 follows speed */
+	__u32 reserved[1];
+	struct omen_rgb_color colors[OMEN_RGB_ZONES];	/* Base colors */
+	struct omen_rgb_color frame[OMEN_RGB_ZONES];	/* Displayed, GET_STATE only */
+};
+
+/*
+ * Frame streaming. mmap() of /dev/omen-rgb maps a struct omen_rgb_ring that
+ * the frame worker samples once per frame while the mode is
+ * OMEN_RGB_MODE_STREAM. It shows the newest complete frame and counts the
+ * frames that were overwritten before it got to them.
+ *
+ * A producer publishes a frame without any syscall:
+ *
+ *	slot = &ring->slot[(ring->head + 1) % OMEN_RGB_RING_SLOTS];
+ *	slot->seq++;			(odd: being written)
+ *	write barrier
+ *	fill slot->colors
+ *	write barrier
+ *	slot->seq++;			(even: complete)
+ *	ring->head = slot index;
+ *	write barrier
+ *	ring->produced++;
+ *
+ * Only the producer writes head, produced and the slots, only the driver
+ * writes shown and dropped.
+ */
+#define OMEN_RGB_RING_VERSION 1
+#define OMEN_RGB_RING_SLOTS 8
+
+struct omen_rgb_slot {
+	__u32 seq;
+	__u32 reserved;
+	struct omen_rgb_color colors[OMEN_RGB_ZONES];
+};
+
+struct omen_rgb_ring {
+	__u32 version;		/* Set by the driver to OMEN_RGB_RING_VERSION */
+	__u32 slots;		/* Set by the driver to OMEN_RGB_RING_SLOTS */
+	__u32 head;		/* Slot of the newest complete frame */
+	__u32 produced;		/* Frames published, wraps */
+	__u32 shown;		/* Frames displayed, wraps */
+	__u32 dropped;		/* Frames never displayed, wraps */
+	__u32 reserved[2];
+	struct omen_rgb_slot slot[OMEN_RGB_RING_SLOTS];
+};
+
+#define OMEN_RGB_IOC_MAGIC	'O'
+
+#define OMEN_RGB_IOC_VERSION	_IOR(OMEN_RGB_IOC_MAGIC, 0, __u32)
+#define OMEN_RGB_IOC_GET_STATE	_IOWR(OMEN_RGB_IOC_MAGIC, 1, struct omen_rgb_state)
+#define OMEN_RGB_IOC_SET_STATE	_IOW(OMEN_RGB_IOC_MAGIC, 2, struct omen_rgb_state)
+
+#endif /* _UAPI_OMEN_RGB_H */